@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "tetris.hpp"
+
+namespace tetris {
+
+    // Many games stepped in lockstep, for reinforcement learning. Every field of the games is stored in its
+    // own array indexed by game, and the arrays are handed out as observations without copying.
+    // The rules are the ones of Tetris::act() with the same GameRules, with the 7-bag and one preview.
+    class BatchEnv final {
+    public:
+        using RowT = Bucket::RowT;
+        static constexpr int ROWS = Bucket::ROWS;
+        static constexpr int COLS = Bucket::COLS;
+
+        // Game i starts from seed + i. Games that end start over from the following seeds, in game order.
+        BatchEnv(size_t size, uint64_t seed, const GameRules& rules = GameRules{}) :
+            rules_{ rules.clamped() },
+            size_{ size },
+            next_seed_{ seed + size },
+            rows_(size * ROWS),
+            x_(size),
+            y_(size),
+            rotation_(size),
+            style_(size),
+            next_(size),
+            score_(size),
+            level_(size),
+            cleared_lines_(size),
+            last_update_(size),
+            game_speed_(size),
+            rewards_(size),
+            done_(size),
+            previous_scores_(size)
+        {
+            previews_.reserve(size);
+            for (size_t i = 0; i < size; ++i) {
+                previews_.emplace_back(BagGenerator{ seed + i }, 1);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                reset_(i);
+            }
+        }
+
+        size_t size() const noexcept { return size_; }
+
+        // Applies actions[i] to game i, restarting the games that ended on the previous step first.
+        // Afterwards rewards() holds the score gained by the step and done() whether the game ended.
+        void step(const Action* actions) {
+            for (size_t i = 0; i < size_; ++i) {
+                if (done_[i]) {
+                    previews_[i].reset(next_seed_++);
+                    reset_(i);
+                }
+                act_(i, actions[i]);
+            }
+            update_rewards_();
+        }
+
+        // size() * ROWS rows of the stacks, game i starts at row i * ROWS. Bit x is set if the cell in column x
+        // is occupied. The falling tetromino isn't included.
+        const RowT* rows() const noexcept { return rows_.data(); }
+        // Falling tetrominoes, Undef style if one is about to spawn.
+        const int8_t* x() const noexcept { return x_.data(); }
+        const int8_t* y() const noexcept { return y_.data(); }
+        const int8_t* rotation() const noexcept { return rotation_.data(); }
+        const BlockStyle* style() const noexcept { return style_.data(); }
+        const BlockStyle* next() const noexcept { return next_.data(); }
+        const uint32_t* score() const noexcept { return score_.data(); }
+        const uint32_t* level() const noexcept { return level_.data(); }
+        const uint32_t* cleared_lines() const noexcept { return cleared_lines_.data(); }
+        const float* rewards() const noexcept { return rewards_.data(); }
+        const uint8_t* done() const noexcept { return done_.data(); }
+
+    private:
+        void reset_(size_t i) noexcept {
+            std::fill_n(rows_.begin() + i * ROWS, ROWS, RowT{ 0 });
+            style_[i] = BlockStyle::Undef;
+            next_[i] = previews_[i][0];
+            score_[i] = 0;
+            level_[i] = 1;
+            cleared_lines_[i] = 0;
+            last_update_[i] = 0;
+            game_speed_[i] = rules_.initial_game_speed;
+            done_[i] = 0;
+            previous_scores_[i] = 0;
+        }
+
+        Tetromino tetromino_(size_t i) const noexcept {
+            Tetromino tetromino{ style_[i], rotation_[i] };
+            tetromino.x = x_[i];
+            tetromino.y = y_[i];
+            return tetromino;
+        }
+
+        bool fits_(size_t i, const Tetromino& tetromino) const noexcept {
+            const auto* rows = &rows_[i * ROWS];
+            int left = tetromino.left();
+            int top = tetromino.top();
+            if (left < 0 || tetromino.right() >= COLS || top < 0 || tetromino.bottom() >= ROWS) {
+                return false;
+            }
+            const auto& shape = tetromino.shape();
+            RowT overlap = 0;
+            for (int row = 0; row < shape.height; ++row) {
+                overlap |= rows[top + row] & (shape.row_masks[row] << left);
+            }
+            return !overlap;
+        }
+
+        void act_(size_t i, Action action) noexcept {
+            if (!try_spawn_(i)) {
+                return;
+            }
+            auto tetromino = tetromino_(i);
+            auto moved = tetromino;
+            switch (action) {
+            case Action::Left:
+            case Action::Right:
+                moved.x += action == Action::Left ? -1 : 1;
+                if (fits_(i, moved)) {
+                    x_[i] = moved.x;
+                }
+                return;
+            case Action::RotateRight:
+            case Action::RotateLeft: {
+                int direction = action == Action::RotateRight ? 1 : -1;
+                moved.rotate(direction);
+                for (auto [dx, dy] : tetromino.wall_kick_tests(direction)) {
+                    moved.x = tetromino.x + dx;
+                    moved.y = tetromino.y + dy;
+                    if (fits_(i, moved)) {
+                        x_[i] = moved.x;
+                        y_[i] = moved.y;
+                        rotation_[i] = moved.rotation();
+                        break;
+                    }
+                }
+                return;
+            }
+            case Action::SoftDrop:
+                last_update_[i] = 0;
+                fall_(i, tetromino);
+                return;
+            case Action::Tick:
+                last_update_[i] += NS_PER_TICK;
+                if (last_update_[i] >= game_speed_[i]) {
+                    last_update_[i] = 0;
+                    fall_(i, tetromino);
+                }
+                return;
+            }
+        }
+
+        // Returns whether a tetromino is falling.
+        bool try_spawn_(size_t i) noexcept {
+            if (done_[i]) {
+                return false;
+            }
+            if (style_[i] != BlockStyle::Undef) {
+                return true;
+            }
+            Tetromino tetromino{ next_[i] };
+            tetromino.x = SPAWN_X;
+            tetromino.y = SPAWN_Y;
+            if (!fits_(i, tetromino)) {
+                done_[i] = 1;
+                return false;
+            }
+            previews_[i].pop();
+            next_[i] = previews_[i][0];
+            style_[i] = tetromino.style();
+            x_[i] = tetromino.x;
+            y_[i] = tetromino.y;
+            rotation_[i] = 0;
+            return true;
+        }
+
+        void fall_(size_t i, Tetromino tetromino) noexcept {
+            tetromino.y += 1;
+            if (fits_(i, tetromino)) {
+                y_[i] = tetromino.y;
+                return;
+            }
+            tetromino.y -= 1;
+            lock_(i, tetromino);
+        }
+
+        void lock_(size_t i, const Tetromino& tetromino) noexcept {
+            auto* rows = &rows_[i * ROWS];
+            const auto& shape = tetromino.shape();
+            int left = tetromino.left();
+            int top = tetromino.top();
+            for (int row = 0; row < shape.height; ++row) {
+                rows[top + row] |= shape.row_masks[row] << left;
+            }
+            int cleared = remove_full_rows_(rows, top, tetromino.bottom());
+            // Counters stop where a GameState does, as in Tetris.
+            score_[i] = static_cast<uint32_t>(std::min<size_t>(size_t{ score_[i] } + rules_.line_scores[cleared], GameState::MAX_COUNT));
+            if (cleared_lines_[i] % 10 + cleared >= 10 && level_[i] < GameState::MAX_LEVEL) {
+                ++level_[i];
+            }
+            cleared_lines_[i] = static_cast<uint32_t>(std::min<size_t>(size_t{ cleared_lines_[i] } + cleared, GameState::MAX_COUNT));
+            game_speed_[i] = rules_.next_game_speed(game_speed_[i], level_[i]);
+            style_[i] = BlockStyle::Undef;
+        }
+
+        // Removes the full rows among [top, bottom], the rows a lock can fill, and returns how many there were.
+        static int remove_full_rows_(RowT* rows, int top, int bottom) noexcept {
+            uint32_t full = 0;
+            for (int y = top; y <= bottom; ++y) {
+                full |= static_cast<uint32_t>(rows[y] == Bucket::FULL_ROW) << y;
+            }
+            if (!full) {
+                return 0;
+            }
+            int to = bottom;
+            for (int from = bottom; from >= 0; --from) {
+                if (!(full >> from & 1)) {
+                    rows[to--] = rows[from];
+                }
+            }
+            for (; to >= 0; --to) {
+                rows[to] = 0;
+            }
+            return __builtin_popcount(full);
+        }
+
+        // Rewards are the score gained by the step, computed 8 games at a time where AVX2 is available.
+        void update_rewards_() noexcept {
+            size_t i = 0;
+#ifdef __AVX2__
+            for (; i + 8 <= size_; i += 8) {
+                auto scores = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&score_[i]));
+                auto previous = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&previous_scores_[i]));
+                _mm256_storeu_ps(&rewards_[i], _mm256_cvtepi32_ps(_mm256_sub_epi32(scores, previous)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&previous_scores_[i]), scores);
+            }
+#endif
+            for (; i < size_; ++i) {
+                rewards_[i] = static_cast<float>(score_[i] - previous_scores_[i]);
+                previous_scores_[i] = score_[i];
+            }
+        }
+
+    private:
+        GameRules rules_;
+        size_t size_;
+        uint64_t next_seed_;
+        std::vector<PreviewQueue> previews_;
+        std::vector<RowT> rows_;
+        std::vector<int8_t> x_;
+        std::vector<int8_t> y_;
+        std::vector<int8_t> rotation_;
+        std::vector<BlockStyle> style_;
+        std::vector<BlockStyle> next_;
+        std::vector<uint32_t> score_;
+        std::vector<uint32_t> level_;
+        std::vector<uint32_t> cleared_lines_;
+        std::vector<long long> last_update_; // in ns
+        std::vector<long long> game_speed_; // in ns
+        std::vector<float> rewards_;
+        std::vector<uint8_t> done_;
+        std::vector<uint32_t> previous_scores_;
+    };
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "batch_env.hpp"
+#include "bot.hpp"
+#include "tetris.hpp"
+
+// Checks that BatchEnv plays the game of Tetris: a batch and as many Tetris instances from the same seeds
+// take the same actions, and their boards, falling and next tetrominoes, scores, rewards, lines, levels and
+// ends are compared after every step, with the standard rules and with faster ones. Most actions steer the
+// tetromino to a good drop, so games clear lines and level up, the rest are random moves and ticks.
+//
+// Usage: tetris-batch-env-test [STEPS]
+
+namespace {
+
+    using tetris::Action;
+    using tetris::BatchEnv;
+    using tetris::BlockStyle;
+    using tetris::Bucket;
+
+    constexpr size_t GAMES = 64;
+    constexpr uint64_t SEED = 100;
+
+    // Rotation and column of the best drop of the falling tetromino straight down, by the board evaluation of
+    // the bot.
+    std::pair<int, int> target_of(const tetris::Tetris& game) {
+        auto stack = game.bucket();
+        stack.remove(game.tetromino());
+        std::pair<int, int> target{ 0, game.tetromino().x };
+        double best = -1e9;
+        for (int8_t rotation = 0; rotation < 4; ++rotation) {
+            for (int8_t x = -2; x < Bucket::COLS; ++x) {
+                tetris::Tetromino dropped{ game.tetromino().style(), rotation };
+                dropped.x = x;
+                // Rotations reach a row or two above their origin.
+                for (dropped.y = -2; dropped.y <= tetris::SPAWN_Y && !stack.fits(dropped); ++dropped.y) {
+                }
+                if (!stack.fits(dropped)) {
+                    continue;
+                }
+                while (stack.fits(dropped)) {
+                    ++dropped.y;
+                }
+                --dropped.y;
+                auto board = stack;
+                board.place(dropped);
+                int cleared = board.remove_full_rows(dropped.top(), dropped.bottom());
+                double score = tetris::evaluate(board, tetris::BotWeights{}) + cleared;
+                if (score > best) {
+                    best = score;
+                    target = { rotation, x };
+                }
+            }
+        }
+        return target;
+    }
+
+    // Steers the falling tetromino to the target planned when it spawned. A fifth of the actions are random
+    // instead, half of them ticks, so tetrominoes also fall under gravity and get pushed off their course.
+    Action steer(const tetris::Tetris& game, std::optional<std::pair<int, int>>& target, tetris::Random& random) {
+        if (game.tetromino().is_undef() || game.game_over()) {
+            target.reset();
+        }
+        else if (!target) {
+            target = target_of(game);
+        }
+        auto action = random.bounded(50);
+        if (action < 10 || !target) {
+            return action % 10 < 5 ? Action::Tick : static_cast<Action>(action % 10 - 5);
+        }
+        auto [rotation, x] = *target;
+        const auto& tetromino = game.tetromino();
+        if (tetromino.rotation() != rotation) {
+            return Action::RotateRight;
+        }
+        if (tetromino.x != x) {
+            return tetromino.x < x ? Action::Right : Action::Left;
+        }
+        return Action::SoftDrop;
+    }
+
+    // Returns the number of (game, step) pairs that differ.
+    size_t compare(const tetris::GameRules& rules, size_t steps) {
+        BatchEnv env{ GAMES, SEED, rules };
+        std::vector<tetris::Tetris> games;
+        for (size_t i = 0; i < GAMES; ++i) {
+            games.emplace_back(SEED + i, 1, rules);
+        }
+        // Games that end start over from the following seeds in game order, as in BatchEnv.
+        uint64_t next_seed = SEED + GAMES;
+        tetris::Random random{ 5 };
+        std::vector<Action> actions(GAMES);
+        std::vector<size_t> rewards(GAMES);
+        std::vector<std::optional<std::pair<int, int>>> targets(GAMES);
+        size_t mismatches = 0;
+        size_t ended = 0;
+        size_t clears = 0;
+        size_t top_level = 0;
+        for (size_t step = 0; step < steps; ++step) {
+            for (size_t i = 0; i < GAMES; ++i) {
+                auto& game = games[i];
+                if (game.game_over()) {
+                    game.reset(next_seed++);
+                    ++ended;
+                }
+                actions[i] = steer(game, targets[i], random);
+                auto score = game.score();
+                game.act(actions[i]);
+                rewards[i] = game.score() - score;
+                clears += rewards[i] != 0;
+                top_level = std::max(top_level, game.level());
+            }
+            env.step(actions.data());
+            for (size_t i = 0; i < GAMES; ++i) {
+                const auto& game = games[i];
+                auto stack = game.bucket();
+                auto tetromino = game.tetromino();
+                bool falling = !tetromino.is_undef() && !game.game_over();
+                if (falling) {
+                    stack.remove(tetromino);
+                }
+                bool same = env.score()[i] == game.score()
+                    && env.rewards()[i] == static_cast<float>(rewards[i])
+                    && env.cleared_lines()[i] == game.cleared_lines()
+                    && env.level()[i] == game.level()
+                    && (env.done()[i] != 0) == game.game_over()
+                    && env.next()[i] == game.next_tetromino().style();
+                for (int y = 0; y < Bucket::ROWS; ++y) {
+                    same = same && env.rows()[i * Bucket::ROWS + y] == stack.row(y);
+                }
+                if (falling) {
+                    same = same && env.style()[i] == tetromino.style() && env.x()[i] == tetromino.x
+                        && env.y()[i] == tetromino.y && env.rotation()[i] == tetromino.rotation();
+                }
+                else if (!game.game_over()) {
+                    same = same && env.style()[i] == BlockStyle::Undef;
+                }
+                if (!same && mismatches++ < 10) {
+                    std::fprintf(stderr, "Game %zu differs from Tetris after step %zu\n", i, step);
+                }
+            }
+        }
+        if (!ended || !clears || top_level <= 10) {
+            std::fprintf(stderr, "%zu games ended, %zu line clears and level %zu reached in %zu steps, too few to cover the rules\n",
+                ended, clears, top_level, steps);
+            ++mismatches;
+        }
+        return mismatches;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t steps = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20'000;
+    tetris::GameRules fast;
+    fast.initial_game_speed = 200'000'000;
+    fast.speed_decay_per_mille = 900;
+    fast.line_scores = { 0, 10, 30, 90, 500 };
+    size_t mismatches = compare(tetris::GameRules{}, steps) + compare(fast, steps);
+    if (mismatches) {
+        std::fprintf(stderr, "%zu game steps differ\n", mismatches);
+        return 1;
+    }
+    std::fprintf(stderr, "%zu steps of %zu games match Tetris\n", steps, GAMES);
+    return 0;
+}
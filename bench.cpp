@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "batch_env.hpp"
+#include "movegen.hpp"
+#include "renderer.hpp"
+#include "tetris.hpp"
+#include "tetris_api.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Microbenchmarks of the engine and renderer hot paths. Boards are built from fixed seeds, so runs of
+// different builds time the same work. Every benchmark is timed in samples of a calibrated number of
+// operations after warmup samples, and reports ns per operation percentiles over the samples.
+//
+// Usage: tetris-bench [--filter TEXT] [--samples N] [--json]
+
+namespace {
+
+    using tetris::Action;
+    using tetris::BlockStyle;
+    using tetris::Bucket;
+    using tetris::Tetris;
+    using tetris::Tetromino;
+
+    struct Result final {
+        std::string name;
+        size_t samples;
+        size_t ops_per_sample;
+        double min; // ns per op
+        double mean;
+        double p50;
+        double p90;
+        double p99;
+    };
+
+    class Bench final {
+    public:
+        Bench(const char* filter, size_t samples) :
+            filter_{ filter },
+            samples_{ samples }
+        {}
+
+        // Times op() unless the name doesn't match the filter. A call of op() counts as items operations.
+        template <typename Op>
+        void run(const std::string& name, Op&& op, size_t items = 1) {
+            if (filter_ && name.find(filter_) == std::string::npos) {
+                return;
+            }
+            constexpr long long MIN_SAMPLE_NS = 50'000;
+            constexpr size_t MAX_OPS_PER_SAMPLE = size_t{ 1 } << 24;
+            constexpr size_t WARMUP_SAMPLES = 10;
+            size_t ops = 1;
+            while (ops < MAX_OPS_PER_SAMPLE && time_(op, ops) < MIN_SAMPLE_NS) {
+                ops *= 2;
+            }
+            for (size_t i = 0; i < WARMUP_SAMPLES; ++i) {
+                time_(op, ops);
+            }
+            std::vector<double> ns_per_op(samples_);
+            for (auto&& ns : ns_per_op) {
+                ns = static_cast<double>(time_(op, ops)) / (ops * items);
+            }
+            std::sort(ns_per_op.begin(), ns_per_op.end());
+            double sum = 0;
+            for (auto ns : ns_per_op) {
+                sum += ns;
+            }
+            auto percentile = [&](size_t p) { return ns_per_op[(ns_per_op.size() - 1) * p / 100]; };
+            results_.push_back(Result{ name, samples_, ops, ns_per_op.front(), sum / samples_, percentile(50), percentile(90), percentile(99) });
+        }
+
+        void print_table() const {
+            std::printf("%-28s %10s %10s %10s %10s %10s\n", "benchmark", "min", "mean", "p50", "p90", "p99");
+            for (auto&& result : results_) {
+                std::printf("%-28s %10.1f %10.1f %10.1f %10.1f %10.1f\n", result.name.c_str(), result.min, result.mean,
+                    result.p50, result.p90, result.p99);
+            }
+            std::printf("ns per op over %zu samples\n", samples_);
+        }
+
+        void print_json() const {
+            std::printf("{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [");
+            for (size_t i = 0; i < results_.size(); ++i) {
+                auto&& result = results_[i];
+                std::printf("%s\n    {\"name\": \"%s\", \"samples\": %zu, \"ops_per_sample\": %zu, "
+                    "\"min\": %.2f, \"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f}",
+                    i ? "," : "", result.name.c_str(), result.samples, result.ops_per_sample, result.min, result.mean,
+                    result.p50, result.p90, result.p99);
+            }
+            std::printf("\n  ]\n}\n");
+        }
+
+    private:
+        template <typename Op>
+        static long long time_(Op& op, size_t ops) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < ops; ++i) {
+                op();
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+
+    private:
+        const char* filter_;
+        size_t samples_;
+        std::vector<Result> results_;
+    };
+
+    // Results of pure computations are summed here, so that they can't be optimized away.
+    volatile uint64_t sink;
+
+    int stack_height(const Bucket& bucket) noexcept {
+        for (int y = 0; y < Bucket::ROWS; ++y) {
+            if (bucket.row(y)) {
+                return Bucket::ROWS - y;
+            }
+        }
+        return 0;
+    }
+
+    // Game with a falling tetromino over a stack at least height rows high, built by locking tetrominoes
+    // at random reachable positions, which leaves holes like a mid-game board does.
+    Tetris stacked_game(uint64_t seed, int height) {
+        tetris::Random random{ seed };
+        tetris::PlacementGenerator generator;
+        std::vector<tetris::Placement> placements;
+        Tetris game{ seed };
+        while (true) {
+            game.update(0);
+            if (game.game_over()) {
+                game.reset(++seed);
+                continue;
+            }
+            auto bucket = game.bucket();
+            bucket.remove(game.tetromino());
+            if (stack_height(bucket) >= height) {
+                return game;
+            }
+            placements.clear();
+            generator.generate(bucket, game.tetromino(), [&](const tetris::Placement& placement) {
+                placements.push_back(placement);
+            });
+            auto placement = placements[random.bounded(static_cast<uint32_t>(placements.size()))];
+            Tetromino tetromino{ game.tetromino().style(), placement.rotation };
+            tetromino.x = placement.x;
+            tetromino.y = placement.y;
+            game.lock(tetromino);
+        }
+    }
+
+    // Times random actions on a bucket Cols wide and Rows high, starting over whenever the game is over.
+    template <int Cols, int Rows>
+    void run_play(Bench& bench, uint64_t seed) {
+        tetris::BasicTetris<Cols, Rows> game{ seed };
+        tetris::Random random{ seed };
+        bench.run("play/" + std::to_string(Cols) + "x" + std::to_string(Rows), [&] {
+            game.act(static_cast<Action>(random.bounded(static_cast<uint32_t>(Action::Tick) + 1)));
+            if (game.game_over()) {
+                game.reset(seed);
+            }
+        });
+    }
+
+    // Redirects stdout to the null device while alive, so that rendering is timed without a terminal.
+    class NullStdout final {
+    public:
+        NullStdout() {
+            std::fflush(stdout);
+#ifdef _WIN32
+            saved_ = _dup(1);
+            int null = _open("NUL", _O_WRONLY);
+            _dup2(null, 1);
+            _close(null);
+#else
+            saved_ = dup(STDOUT_FILENO);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+#endif
+        }
+
+        ~NullStdout() {
+#ifdef _WIN32
+            _dup2(saved_, 1);
+            _close(saved_);
+#else
+            dup2(saved_, STDOUT_FILENO);
+            close(saved_);
+#endif
+        }
+
+        NullStdout(const NullStdout&) = delete;
+        NullStdout& operator=(const NullStdout&) = delete;
+
+    private:
+        int saved_;
+    };
+
+    size_t parse_count(const char* text) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || !value) {
+            std::fprintf(stderr, "Expected a positive number, got '%s'\n", text);
+            std::exit(1);
+        }
+        return value;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    size_t samples = 200;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--json")) {
+            json = true;
+        }
+        else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = parse_count(argv[++i]);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    constexpr uint64_t SEED = 2024;
+    struct Board final {
+        const char* name;
+        Tetris game;
+    };
+    const Board boards[] = {
+        { "empty", stacked_game(SEED, 0) },
+        { "mid", stacked_game(SEED, 8) },
+        { "topout", stacked_game(SEED, 16) }
+    };
+
+    Bench bench{ filter, samples };
+
+    {
+        Tetris game{ SEED };
+        bench.run("update/tick", [&] {
+            game.update(tetris::NS_PER_TICK);
+            if (game.game_over()) {
+                game.reset(SEED);
+            }
+        });
+    }
+
+    run_play<4, 20>(bench, SEED);
+    run_play<40, 80>(bench, SEED);
+
+    // Through libtetris, like harnesses drive games in process. A batch op steps every game once.
+    {
+        constexpr size_t BATCH = 64;
+        std::vector<tetris_game*> games(BATCH);
+        for (size_t i = 0; i < BATCH; ++i) {
+            games[i] = tetris_create(SEED + i, 1);
+        }
+        std::vector<uint8_t> actions(BATCH);
+        std::vector<uint8_t> changed(BATCH);
+        tetris::Random random{ SEED };
+        bench.run("capi/step", [&] {
+            tetris_step(games[0], random.bounded(TETRIS_TICK + 1));
+            if (tetris_game_over(games[0])) {
+                tetris_reset(games[0], SEED);
+            }
+        });
+        bench.run("capi/step_batch/" + std::to_string(BATCH), [&] {
+            for (auto&& action : actions) {
+                action = static_cast<uint8_t>(random.bounded(TETRIS_TICK + 1));
+            }
+            tetris_step_batch(games.data(), actions.data(), changed.data(), BATCH);
+            for (size_t i = 0; i < BATCH; ++i) {
+                if (tetris_game_over(games[i])) {
+                    tetris_reset(games[i], SEED + i);
+                }
+            }
+        });
+        bench.run("capi/clone", [&] { tetris_destroy(tetris_clone(games[0])); });
+        for (auto* game : games) {
+            tetris_destroy(game);
+        }
+    }
+
+    // A batch op steps every game once and counts as a step per game. Actions are drawn up front, so that
+    // the random generator isn't timed along.
+    for (size_t size : { 1024, 16384 }) {
+        constexpr size_t PLANS = 64;
+        tetris::BatchEnv env{ size, SEED };
+        tetris::Random random{ SEED };
+        std::vector<std::vector<Action>> plans(PLANS, std::vector<Action>(size));
+        for (auto&& plan : plans) {
+            for (auto&& action : plan) {
+                action = static_cast<Action>(random.bounded(static_cast<uint32_t>(Action::Tick) + 1));
+            }
+        }
+        size_t i = 0;
+        bench.run("batch_env/step/" + std::to_string(size), [&] {
+            env.step(plans[++i % PLANS].data());
+            sink = sink + env.score()[0];
+        }, size);
+    }
+
+    for (auto&& board : boards) {
+        auto game = board.game;
+        size_t i = 0;
+        bench.run(std::string{ "move/" } + board.name, [&] {
+            game.act(++i & 1 ? Action::Left : Action::Right);
+        });
+    }
+
+    for (auto&& board : boards) {
+        auto game = board.game;
+        size_t i = 0;
+        bench.run(std::string{ "rotate/" } + board.name, [&] {
+            game.act(++i & 1 ? Action::RotateRight : Action::RotateLeft);
+        });
+    }
+
+    for (auto&& board : boards) {
+        const auto& game = board.game;
+        bench.run(std::string{ "drop/" } + board.name, [&] { sink = sink + game.dropped().y; });
+    }
+
+    for (int lines = 1; lines <= 4; ++lines) {
+        // Full rows at the bottom under the mid-game stack, the rest of the bottom four rows with a gap.
+        auto stack = boards[1].game.bucket();
+        stack.remove(boards[1].game.tetromino());
+        for (int y = Bucket::ROWS - 4; y < Bucket::ROWS; ++y) {
+            stack.set_row(y, y >= Bucket::ROWS - lines ? Bucket::FULL_ROW : Bucket::FULL_ROW & ~(1 << y % Bucket::COLS));
+        }
+        bench.run("remove_full_rows/" + std::to_string(lines), [&] {
+            auto bucket = stack;
+            sink = sink + bucket.remove_full_rows(Bucket::ROWS - 4, Bucket::ROWS - 1) + bucket.hash();
+        });
+    }
+
+    {
+        size_t i = 0;
+        bench.run("tetromino/minos", [&] {
+            Tetromino tetromino{ static_cast<BlockStyle>(i % 7), static_cast<int8_t>(i / 7 % 4) };
+            ++i;
+            uint64_t sum = 0;
+            for (auto&& mino : tetromino.minos()) {
+                sum += static_cast<uint64_t>(mino.x * 8 + mino.y);
+            }
+            sink = sink + sum;
+        });
+    }
+
+    for (auto&& board : boards) {
+        tetris::PlacementGenerator generator;
+        auto bucket = board.game.bucket();
+        bucket.remove(board.game.tetromino());
+        auto tetromino = board.game.tetromino();
+        bench.run(std::string{ "movegen/" } + board.name, [&] {
+            uint64_t count = 0;
+            generator.generate(bucket, tetromino, [&](const tetris::Placement&) { ++count; });
+            sink = sink + count;
+        });
+    }
+
+    {
+        NullStdout null_stdout;
+        tetris::TerminalTetrisRenderer renderer;
+        renderer.render();
+        const auto& game = boards[1].game;
+        bench.run("draw/bucket", [&] { renderer.draw_bucket(game.bucket()); });
+        bench.run("draw/next_tetromino", [&] { renderer.draw_next_tetromino(game.next_tetromino()); });
+        bench.run("draw/score", [&] { renderer.draw_score(game.score()); });
+        bench.run("draw/level", [&] { renderer.draw_level(game.level()); });
+        bench.run("draw/cleared_lines", [&] { renderer.draw_cleared_lines(game.cleared_lines()); });
+        // Frames alternate between two games, so every frame has changes to write.
+        size_t i = 0;
+        bench.run("frame", [&] {
+            renderer.draw_game(boards[1 + (++i & 1)].game);
+            renderer.render();
+        });
+    }
+
+    if (json) {
+        bench.print_json();
+    }
+    else {
+        bench.print_table();
+    }
+    return 0;
+}
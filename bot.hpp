@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "movegen.hpp"
+#include "tetris.hpp"
+#include "thread_pool.hpp"
+#include "transposition_table.hpp"
+
+namespace tetris {
+
+    // Weights of the board features, boards with higher scores are better.
+    struct BotWeights final {
+        double aggregate_height = -0.510066;
+        double holes = -0.35663;
+        double bumpiness = -0.184483;
+        double wells = -0.1;
+        double cleared_lines = 0.760666;
+    };
+
+    struct BotConfig final {
+        size_t beam_width = 8;
+        size_t depth = 2; // tetrominoes searched, the falling one included
+        BotWeights weights;
+        // Bytes of a transposition table caching board scores, 0 for none. Scoring from the kept features costs
+        // about as much as a probe missing the cache, so a table pays off for searches that revisit boards a lot.
+        size_t table_bytes = 0;
+    };
+
+    // Scores the stack by its aggregate column height, holes, bumpiness and the depth of its wells.
+    inline double evaluate(const BoardFeatures& features, const BotWeights& weights) noexcept {
+        const auto& heights = features.heights();
+        int bumpiness = 0;
+        int wells = 0;
+        for (int x = 0; x < Bucket::COLS; ++x) {
+            if (x > 0) {
+                bumpiness += std::abs(heights[x] - heights[x - 1]);
+            }
+            int left = x > 0 ? heights[x - 1] : Bucket::ROWS;
+            int right = x < Bucket::COLS - 1 ? heights[x + 1] : Bucket::ROWS;
+            wells += std::max(std::min(left, right) - heights[x], 0);
+        }
+        return weights.aggregate_height * features.aggregate_height()
+            + weights.holes * features.holes()
+            + weights.bumpiness * bumpiness
+            + weights.wells * wells;
+    }
+
+    inline double evaluate(const Bucket& bucket, const BotWeights& weights) noexcept {
+        return evaluate(BoardFeatures{ bucket }, weights);
+    }
+
+    // Plays by searching the placements of the falling tetromino and the previews. Every level keeps the
+    // beam_width best distinct boards and expands them in parallel on the pool. Children are kept in the order of
+    // their parents and placements whatever thread scored them, so results don't depend on the pool size.
+    //
+    // With BotConfig::table_bytes, board scores are cached in a transposition table by Bucket::hash(), so a board
+    // reached again, by another order of placements or on a later move, is looked up instead of scored. Scores
+    // are rounded to the float the table holds either way, so the table doesn't change the moves.
+    class BeamSearchBot final {
+    public:
+        BeamSearchBot(ThreadPool& pool, const BotConfig& config) :
+            pool_{ pool },
+            config_{ config },
+            table_{ config.table_bytes ? std::make_unique<TranspositionTable>(config.table_bytes, ReplacementPolicy::Always) : nullptr },
+            evaluated_placements_{ 0 }
+        {
+            assert(config_.beam_width > 0 && config_.depth > 0 && "Bot has nothing to search");
+        }
+
+        // Where to lock the falling tetromino, or the next one if none is falling yet, to pass to Tetris::lock().
+        // Returns Undef if the game is over or the tetromino can't be placed.
+        Tetromino choose(const Tetris& game) {
+            if (game.game_over()) {
+                return Tetromino::Undef();
+            }
+            auto bucket = game.bucket();
+            auto tetromino = game.tetromino();
+            size_t first_preview = 0;
+            if (tetromino.is_undef()) {
+                tetromino = spawned_(game.next_tetromino());
+                first_preview = 1;
+            }
+            else {
+                bucket.remove(tetromino);
+            }
+            size_t depth = std::min(config_.depth, game.preview_depth() - first_preview + 1);
+
+            beam_.assign(1, Node{ bucket, game.features(), 0.0, 0, Tetromino::Undef(), false });
+            for (size_t level = 0; level < depth; ++level) {
+                if (level > 0) {
+                    tetromino = spawned_(game.preview(first_preview + level - 1));
+                }
+                // Placements are listed per beam node, but the children of all nodes are scored in chunks, so
+                // there are tasks for every thread even when the beam is a single board.
+                if (placements_.size() < beam_.size()) {
+                    placements_.resize(beam_.size());
+                    generators_.resize(beam_.size());
+                }
+                pool_.parallel_for(beam_.size(), [&](size_t i) {
+                    list_placements_(beam_[i], tetromino, generators_[i], placements_[i]);
+                });
+                children_.clear();
+                for (size_t i = 0; i < beam_.size(); ++i) {
+                    for (auto&& placement : placements_[i]) {
+                        children_.push_back(Child{ static_cast<uint32_t>(i), placement });
+                    }
+                }
+                next_beam_.resize(children_.size());
+                size_t tasks = TASKS_PER_THREAD * pool_.size();
+                size_t chunk = std::max(MIN_CHUNK, (children_.size() + tasks - 1) / tasks);
+                pool_.parallel_for((children_.size() + chunk - 1) / chunk, [&](size_t task) {
+                    size_t end = std::min(children_.size(), (task + 1) * chunk);
+                    for (size_t i = task * chunk; i < end; ++i) {
+                        next_beam_[i] = child_(beam_[children_[i].parent], tetromino, children_[i].placement);
+                    }
+                });
+                evaluated_placements_ += next_beam_.size();
+                if (next_beam_.empty()) {
+                    // Every board tops out, go with the best of the last level.
+                    break;
+                }
+                select_();
+            }
+            return beam_.front().first;
+        }
+
+        // Placements scored since the bot was created, from the table or not.
+        size_t evaluated_placements() const noexcept { return evaluated_placements_; }
+        // The transposition table, nullptr if BotConfig::table_bytes is 0.
+        const TranspositionTable* table() const noexcept { return table_.get(); }
+
+    private:
+        struct Node final {
+            Bucket bucket;
+            BoardFeatures features; // kept along with the bucket, so that boards aren't scanned to be scored
+            double score;
+            int cleared_lines;
+            Tetromino first = Tetromino::Undef(); // placement of the falling tetromino the board descends from
+            bool stale_features; // the score came from the table and the features weren't kept along
+        };
+
+        struct Child final {
+            uint32_t parent; // index in beam_
+            Placement placement;
+        };
+
+    private:
+        // Children of a level are scored in chunks of at least MIN_CHUNK, about TASKS_PER_THREAD per thread,
+        // so that stealing evens out the threads without a task per child.
+        static constexpr size_t MIN_CHUNK = 4;
+        static constexpr size_t TASKS_PER_THREAD = 4;
+
+    private:
+        static Tetromino spawned_(Tetromino tetromino) noexcept {
+            tetromino.x = SPAWN_X;
+            tetromino.y = SPAWN_Y;
+            return tetromino;
+        }
+
+        static void list_placements_(const Node& node, const Tetromino& tetromino, PlacementGenerator& generator, std::vector<Placement>& placements) {
+            placements.clear();
+            if (!node.bucket.fits(tetromino)) {
+                return;
+            }
+            generator.generate(node.bucket, tetromino, [&](const Placement& placement) { placements.push_back(placement); });
+        }
+
+        Node child_(const Node& node, const Tetromino& tetromino, const Placement& placement) const noexcept {
+            Tetromino placed{ tetromino.style(), placement.rotation };
+            placed.x = placement.x;
+            placed.y = placement.y;
+            Node child{ node.bucket, node.features, 0.0, node.cleared_lines, node.first.is_undef() ? placed : node.first, false };
+            child.bucket.place(placed);
+            child.cleared_lines += child.bucket.remove_full_rows(placed.top(), placed.bottom());
+            TranspositionEntry entry{};
+            if (!table_ || !table_->probe(child.bucket.hash(), entry)) {
+                child.features.place(placed);
+                if (int full_rows = child.features.full_rows(placed.top(), placed.bottom())) {
+                    child.features.remove_full_rows(child.bucket, placed.top(), full_rows);
+                }
+                entry.value = static_cast<float>(evaluate(child.features, config_.weights));
+                if (table_) {
+                    table_->store(child.bucket.hash(), entry);
+                }
+            }
+            else {
+                child.stale_features = true;
+            }
+            child.score = entry.value + config_.weights.cleared_lines * child.cleared_lines;
+            return child;
+        }
+
+        // Keeps the beam_width best children with distinct boards as the next beam, the first one of equal scores.
+        // A board reached by several placements is kept once, with its best score.
+        void select_() {
+            size_t width = std::min(config_.beam_width, next_beam_.size());
+            beam_.clear();
+            for (auto&& child : next_beam_) {
+                if (beam_.size() == width && child.score <= beam_.back().score) {
+                    continue;
+                }
+                auto same = std::find_if(beam_.begin(), beam_.end(), [&](const Node& node) {
+                    return node.bucket.hash() == child.bucket.hash();
+                });
+                if (same != beam_.end()) {
+                    if (child.score <= same->score) {
+                        continue;
+                    }
+                    beam_.erase(same);
+                }
+                else if (beam_.size() == width) {
+                    beam_.pop_back();
+                }
+                auto position = std::upper_bound(beam_.begin(), beam_.end(), child, [](const Node& lhs, const Node& rhs) {
+                    return lhs.score > rhs.score;
+                });
+                beam_.insert(position, child);
+            }
+            for (auto&& node : beam_) {
+                if (node.stale_features) {
+                    node.features = BoardFeatures{ node.bucket };
+                    node.stale_features = false;
+                }
+            }
+        }
+
+    private:
+        ThreadPool& pool_;
+        BotConfig config_;
+        std::unique_ptr<TranspositionTable> table_;
+        size_t evaluated_placements_;
+        std::vector<Node> beam_;
+        std::vector<Node> next_beam_;
+        std::vector<std::vector<Placement>> placements_; // placements from beam_[i], filled by the task listing them
+        std::vector<PlacementGenerator> generators_;
+        std::vector<Child> children_; // of all nodes of the level, in the order of next_beam_
+    };
+}
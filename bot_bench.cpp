@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bot.hpp"
+#include "tetris.hpp"
+#include "thread_pool.hpp"
+
+// Measures how bot throughput scales with threads: every run plays the same games from the same seeds,
+// so all runs do the same work and only the thread count differs.
+//
+// Usage: tetris-bot-bench [--width N] [--depth N] [--pieces N] [--max-threads N] [--table-mb N]
+
+namespace {
+
+    struct Run final {
+        size_t threads;
+        size_t pieces;
+        size_t placements;
+        double seconds;
+        double table_hits; // share of probes, 0 without a table
+    };
+
+    Run play(size_t threads, const tetris::BotConfig& config, size_t pieces) {
+        constexpr uint64_t FIRST_SEED = 1;
+        tetris::ThreadPool pool{ threads };
+        tetris::BeamSearchBot bot{ pool, config };
+        uint64_t seed = FIRST_SEED;
+        // The falling tetromino is searched too, so one preview less is enough.
+        size_t preview_depth = std::clamp<size_t>(config.depth - 1, 1, tetris::PreviewQueue::MAX_DEPTH);
+        tetris::Tetris game{ seed, preview_depth };
+        auto start = std::chrono::steady_clock::now();
+        for (size_t placed = 0; placed < pieces; ++placed) {
+            auto tetromino = bot.choose(game);
+            if (tetromino.is_undef()) {
+                game.reset(++seed);
+                continue;
+            }
+            game.lock(tetromino);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double table_hits = 0;
+        if (const auto* table = bot.table()) {
+            table_hits = static_cast<double>(table->hits()) / std::max<uint64_t>(table->hits() + table->misses(), 1);
+        }
+        return Run{ threads, pieces, bot.evaluated_placements(), elapsed.count(), table_hits };
+    }
+
+    size_t parse_count(const char* text, bool allow_zero = false) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || *text == '-' || (!value && !allow_zero)) {
+            std::fprintf(stderr, "Expected a %s number, got '%s'\n", allow_zero ? "non-negative" : "positive", text);
+            std::exit(1);
+        }
+        return value;
+    }
+}
+
+int main(int argc, char** argv) {
+    tetris::BotConfig config;
+    config.beam_width = 32;
+    config.depth = 3;
+    size_t pieces = 500;
+    size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--width")) {
+            config.beam_width = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--depth")) {
+            config.depth = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--pieces")) {
+            pieces = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--max-threads")) {
+            max_threads = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--table-mb")) {
+            config.table_bytes = parse_count(argv[i + 1], true) << 20;
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::fprintf(stderr, "Option '%s' needs a value\n", argv[argc - 1]);
+        return 1;
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    std::printf("beam width %zu, depth %zu, %zu pieces per run, table %zu MiB\n", config.beam_width, config.depth, pieces,
+        config.table_bytes >> 20);
+    std::printf("%8s %12s %16s %20s %8s %10s\n", "threads", "pieces/s", "placements/s", "placements/s/thread", "speedup", "efficiency");
+    double single_thread_rate = 0;
+    for (auto threads : thread_counts) {
+        auto run = play(threads, config, pieces);
+        double rate = run.placements / run.seconds;
+        if (threads == 1) {
+            single_thread_rate = rate;
+        }
+        double speedup = rate / single_thread_rate;
+        std::printf("%8zu %12.0f %16.0f %20.0f %8.2f %9.0f%%", run.threads, run.pieces / run.seconds, rate,
+            rate / threads, speedup, 100 * speedup / threads);
+        if (config.table_bytes) {
+            std::printf(", %.1f%% table hits", 100 * run.table_hits);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace tetris {
+
+    // Hands the newest of a stream of values from one writer thread to one reader thread without locks.
+    // The writer fills back() and publishes it; the reader switches to the newest published value, so values
+    // published in between are dropped and neither side ever waits for the other.
+    template <typename T>
+    class TripleBuffer final {
+    public:
+        TripleBuffer() : slots_{}, middle_{ 1 }, back_{ 0 }, front_{ 2 } {}
+
+        // Value the writer fills next.
+        T& back() noexcept { return slots_[back_].value; }
+
+        void publish() noexcept {
+            back_ = middle_.exchange(static_cast<uint8_t>(back_ | FRESH), std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Switches front() to the newest published value. Returns false if nothing was published since the last switch.
+        bool update() noexcept {
+            if (!(middle_.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        const T& front() const noexcept { return slots_[front_].value; }
+
+    private:
+        static constexpr uint8_t INDEX = 3;
+        static constexpr uint8_t FRESH = 4; // set in middle_ while it holds a value the reader hasn't seen
+
+        struct alignas(64) Slot final {
+            T value;
+        };
+
+    private:
+        std::array<Slot, 3> slots_;
+        alignas(64) std::atomic<uint8_t> middle_; // index of the slot between the writer and the reader
+        alignas(64) uint8_t back_;
+        alignas(64) uint8_t front_;
+    };
+
+    // Bounded queue from one producer thread to one consumer thread without locks.
+    template <typename T, size_t Capacity>
+    class SpscRing final {
+        static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity has to be a power of two");
+
+    public:
+        SpscRing() : values_{}, head_{ 0 }, tail_{ 0 } {}
+
+        // Returns false if the ring is full.
+        bool push(const T& value) noexcept {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+            values_[tail & (Capacity - 1)] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false if the ring is empty.
+        bool pop(T& value) noexcept {
+            auto head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = values_[head & (Capacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::array<T, Capacity> values_;
+        alignas(64) std::atomic<size_t> head_; // written by the consumer
+        alignas(64) std::atomic<size_t> tail_; // written by the producer
+    };
+
+    // Lets a thread sleep until a deadline or until another thread has work for it. The mutex is only held
+    // to go to sleep and to wake up, never while data is handed over.
+    class Wakeup final {
+    public:
+        Wakeup() : notified_{ false } {}
+
+        void notify() {
+            {
+                std::lock_guard lock{ mutex_ };
+                notified_ = true;
+            }
+            condition_.notify_one();
+        }
+
+        // Returns once notified or at the steady clock deadline in ns, which is never if negative.
+        void wait_until(long long deadline) {
+            std::unique_lock lock{ mutex_ };
+            auto notified = [this] { return notified_; };
+            if (deadline < 0) {
+                condition_.wait(lock, notified);
+            }
+            else {
+                std::chrono::steady_clock::time_point time{ std::chrono::nanoseconds{ deadline } };
+                condition_.wait_until(lock, time, notified);
+            }
+            notified_ = false;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool notified_;
+    };
+}
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+#include "tetris.hpp"
+#include "timer_wheel.hpp"
+
+// Load generator for tetris-server: opens sessions that each send random inputs at a fixed rate, and
+// measures the latency from sending an input to receiving the frame that acknowledges it. With the cores
+// the server reports, this gives sessions per core at a tail latency.
+//
+// Usage: tetris-loadgen [--socket PATH] [--sessions N] [--threads N] [--duration SECONDS] [--rate INPUTS]
+//
+// --rate is inputs per second per session. Sessions whose inputs aren't acknowledged fall behind by at most
+// WINDOW inputs, then skip sending until they catch up.
+
+namespace {
+
+    using tetris::TimerWheel;
+    namespace protocol = tetris::protocol;
+
+    long long steady_now() noexcept {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Options final {
+        const char* path = "/tmp/tetris.sock";
+        size_t sessions = 1000;
+        size_t threads = 1;
+        size_t duration = 10;
+        size_t rate = 10;
+    };
+
+    struct Totals final {
+        uint64_t sessions = 0;
+        uint64_t sent = 0;
+        uint64_t acknowledged = 0;
+        uint64_t skipped = 0;
+        uint64_t disconnected = 0;
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        std::vector<long long> latencies; // ns
+    };
+
+    struct Client final {
+        static constexpr uint32_t WINDOW = 64;
+
+        explicit Client(int fd, uint64_t seed) :
+            fd{ fd },
+            random{ seed },
+            sent{ 0 },
+            acknowledged{ 0 },
+            sent_at{},
+            in{},
+            in_size{ 0 },
+            rows{},
+            game_over{ false }
+        {}
+
+        int fd;
+        tetris::Random random;
+        uint32_t sent;
+        uint32_t acknowledged;
+        std::array<long long, WINDOW> sent_at; // by input number modulo WINDOW
+        std::array<uint8_t, 4096> in;
+        size_t in_size;
+        protocol::RowsT rows;
+        bool game_over;
+    };
+
+    // Runs its share of the sessions on its own epoll instance.
+    class LoadThread final {
+    public:
+        LoadThread(const Options& options, size_t first, size_t count) :
+            options_{ options },
+            first_{ first },
+            count_{ count },
+            epoll_{ epoll_create1(EPOLL_CLOEXEC) },
+            wheel_{ steady_now() }
+        {
+            if (epoll_ < 0) {
+                std::perror("epoll_create1");
+                std::exit(1);
+            }
+        }
+
+        ~LoadThread() {
+            for (auto&& client : clients_) {
+                close(client->fd);
+            }
+            close(epoll_);
+        }
+
+        LoadThread(const LoadThread&) = delete;
+        LoadThread& operator=(const LoadThread&) = delete;
+
+        // Connects the sessions. Returns false if any of them couldn't connect.
+        bool connect() {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::strncpy(address.sun_path, options_.path, sizeof(address.sun_path) - 1);
+            for (size_t i = 0; i < count_; ++i) {
+                int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+                    std::perror(options_.path);
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    return false;
+                }
+                std::array<uint8_t, protocol::HELLO_SIZE> hello;
+                protocol::encode_hello(hello.data(), first_ + i);
+                if (write(fd, hello.data(), hello.size()) != static_cast<ssize_t>(hello.size())) {
+                    std::perror("write");
+                    close(fd);
+                    return false;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                auto id = static_cast<uint32_t>(clients_.size());
+                clients_.push_back(std::make_unique<Client>(fd, first_ + i));
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.u32 = id;
+                epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+            }
+            return true;
+        }
+
+        void run(long long end) {
+            constexpr int MAX_EVENTS = 256;
+            auto interval = 1'000'000'000LL / static_cast<long long>(options_.rate);
+            std::array<epoll_event, MAX_EVENTS> events;
+            totals_.sessions = clients_.size();
+            // Spread over the interval, so that sessions don't send in lockstep.
+            auto start = steady_now();
+            for (uint32_t id = 0; id < clients_.size(); ++id) {
+                wheel_.schedule(id, start + clients_[id]->random.bounded(static_cast<uint32_t>(interval)));
+            }
+            while (true) {
+                auto now = steady_now();
+                if (now >= end) {
+                    break;
+                }
+                auto wait = (std::min(wheel_.next_tick_time(), end) - now + 999'999) / 1'000'000;
+                int n = epoll_wait(epoll_, events.data(), MAX_EVENTS, static_cast<int>(wait));
+                now = steady_now();
+                for (int i = 0; i < n; ++i) {
+                    receive_(*clients_[events[i].data.u32], now);
+                }
+                wheel_.advance(now, [&](uint32_t id) {
+                    send_(*clients_[id], now);
+                    wheel_.schedule(id, now + interval);
+                });
+            }
+        }
+
+        Totals& totals() noexcept { return totals_; }
+
+    private:
+        void send_(Client& client, long long now) {
+            if (client.sent - client.acknowledged >= Client::WINDOW) {
+                ++totals_.skipped;
+                return;
+            }
+            // Moves after the game is over would be ignored.
+            auto input = client.game_over ? protocol::RESET : static_cast<uint8_t>(client.random.bounded(5));
+            if (::send(client.fd, &input, 1, MSG_NOSIGNAL) != 1) {
+                ++totals_.skipped;
+                return;
+            }
+            client.sent_at[client.sent % Client::WINDOW] = now;
+            ++client.sent;
+            ++totals_.sent;
+        }
+
+        void receive_(Client& client, long long now) {
+            while (true) {
+                auto n = recv(client.fd, client.in.data() + client.in_size, client.in.size() - client.in_size, 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return;
+                }
+                if (n <= 0) {
+                    // Stops watching the session, its inputs go unacknowledged.
+                    epoll_ctl(epoll_, EPOLL_CTL_DEL, client.fd, nullptr);
+                    ++totals_.disconnected;
+                    return;
+                }
+                totals_.bytes += static_cast<uint64_t>(n);
+                client.in_size += static_cast<size_t>(n);
+                size_t offset = 0;
+                protocol::Frame frame;
+                while (auto size = protocol::decode_frame(client.in.data() + offset, client.in_size - offset, frame, client.rows)) {
+                    if (size == protocol::INVALID_FRAME) {
+                        // The stream can't be followed past it, the session is dropped like a disconnected one.
+                        std::fprintf(stderr, "Received an invalid frame, dropping the session\n");
+                        epoll_ctl(epoll_, EPOLL_CTL_DEL, client.fd, nullptr);
+                        ++totals_.disconnected;
+                        client.in_size = 0;
+                        return;
+                    }
+                    offset += size;
+                    ++totals_.frames;
+                    for (; client.acknowledged < frame.inputs; ++client.acknowledged) {
+                        totals_.latencies.push_back(now - client.sent_at[client.acknowledged % Client::WINDOW]);
+                    }
+                    client.game_over = frame.game_over;
+                }
+                std::memmove(client.in.data(), client.in.data() + offset, client.in_size - offset);
+                client.in_size -= offset;
+            }
+        }
+
+    private:
+        const Options& options_;
+        size_t first_;
+        size_t count_;
+        int epoll_;
+        TimerWheel wheel_;
+        std::vector<std::unique_ptr<Client>> clients_;
+        Totals totals_;
+    };
+
+    void raise_file_limit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    size_t parse_count(const char* text) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || *text == '-' || !value) {
+            std::fprintf(stderr, "Expected a positive number, got '%s'\n", text);
+            std::exit(1);
+        }
+        return value;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--socket")) {
+            options.path = argv[i + 1];
+        }
+        else if (!std::strcmp(argv[i], "--sessions")) {
+            options.sessions = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--threads")) {
+            options.threads = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--duration")) {
+            options.duration = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--rate")) {
+            options.rate = parse_count(argv[i + 1]);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::fprintf(stderr, "Option '%s' needs a value\n", argv[argc - 1]);
+        return 1;
+    }
+    options.threads = std::min(options.threads, options.sessions);
+    raise_file_limit();
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<LoadThread>> threads;
+    for (size_t i = 0; i < options.threads; ++i) {
+        auto first = options.sessions * i / options.threads;
+        auto last = options.sessions * (i + 1) / options.threads;
+        threads.push_back(std::make_unique<LoadThread>(options, first, last - first));
+        if (!threads.back()->connect()) {
+            return 1;
+        }
+    }
+    auto start = steady_now();
+    auto end = start + static_cast<long long>(options.duration) * 1'000'000'000;
+    std::vector<std::thread> workers;
+    for (auto&& thread : threads) {
+        workers.emplace_back([&thread, end] { thread->run(end); });
+    }
+    for (auto&& worker : workers) {
+        worker.join();
+    }
+    double seconds = (steady_now() - start) / 1e9;
+
+    Totals totals;
+    for (auto&& thread : threads) {
+        auto& t = thread->totals();
+        totals.sessions += t.sessions;
+        totals.sent += t.sent;
+        totals.skipped += t.skipped;
+        totals.disconnected += t.disconnected;
+        totals.frames += t.frames;
+        totals.bytes += t.bytes;
+        totals.latencies.insert(totals.latencies.end(), t.latencies.begin(), t.latencies.end());
+    }
+    totals.acknowledged = totals.latencies.size();
+    auto& latencies = totals.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[static_cast<size_t>((latencies.size() - 1) * p / 100)] / 1e3;
+    };
+
+    std::printf("%llu sessions, %zu threads, %.1f s, %llu disconnected\n", static_cast<unsigned long long>(totals.sessions),
+        options.threads, seconds, static_cast<unsigned long long>(totals.disconnected));
+    std::printf("inputs sent %llu (%.0f/s), acknowledged %llu, skipped %llu\n", static_cast<unsigned long long>(totals.sent),
+        totals.sent / seconds, static_cast<unsigned long long>(totals.acknowledged), static_cast<unsigned long long>(totals.skipped));
+    std::printf("frames %llu (%.0f/s), %.1f KiB/s\n", static_cast<unsigned long long>(totals.frames), totals.frames / seconds,
+        totals.bytes / seconds / 1024);
+    std::printf("input to frame latency us: p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f max %.0f\n", percentile(50), percentile(90),
+        percentile(99), percentile(99.9), percentile(100));
+    return 0;
+}
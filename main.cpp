@@ -1,602 +1,849 @@
-#include <algorithm>
-#include <array>
-#include <cassert>
-#include <chrono>
-#include <cstdint>
-#include <iomanip>
-#include <iostream>
-#include <string>
-#include <sstream>
-
-#include <Windows.h>
-
-namespace {
-
-    struct Mino final {
-        int8_t x;
-        int8_t y;
-    };
-
-    using BucketT = std::array<std::array<bool, 10>, 20>;
-    using MinosT = std::array<Mino, 4>;
-
-    class Tetromino final {
-    public:
-        enum class BlockStyle : unsigned {
-            I, J, L, O, S, T, Z, Undef
-        };
-
-    public:
-        int8_t x;
-        int8_t y;
-
-    public:
-        static Tetromino I() {
-            return { {{ { -2, 0 }, { -1, 0 }, { 0, 0 }, { 1, 0 } }}, BlockStyle::I };
-        }
-        static Tetromino J() {
-            return { {{ { -1, -1 }, { -1, 0 }, { 0, 0 }, { 1, 0 } }}, BlockStyle::J };
-        }
-        static Tetromino L() {
-            return { {{ { -1, 0 }, { 0, 0 }, { 1, 0 }, { 1, -1 } }}, BlockStyle::L };
-        }
-        static Tetromino O() {
-            return { {{ { -1, -1 }, { 0, -1 }, { -1, 0 }, { 0, 0 } }}, BlockStyle::O };
-        }
-        static Tetromino S() {
-            return { {{ { -1, 0 }, { 0, 0 }, { 0, -1 }, { 1, -1 } }}, BlockStyle::S };
-        }
-        static Tetromino T() {
-            return { {{ { -1, 0 }, { 0, 0 }, { 1, 0 }, { 0, -1 } }}, BlockStyle::T };
-        }
-        static Tetromino Z() {
-            return { {{ { -1, -1 }, { 0, -1 }, { 0, 0 }, { 1, 0 } }}, BlockStyle::Z };
-        }
-        static Tetromino Undef() {
-            return { {{}}, BlockStyle::Undef };
-        }
-
-        void rotate() noexcept {
-            assert(style_ != BlockStyle::Undef && "Rotation of undefined block is impossible");
-            rotation_ = (rotation_ + 1) % 4;
-            switch (style_) {
-            case BlockStyle::I: rotate_I_(); break;
-            case BlockStyle::O: break;
-            default: {
-                for (auto&& mino : minos_) {
-                    auto tmp = mino.x;
-                    mino.x = -1 * mino.y;
-                    mino.y = tmp;
-                }
-            }
-            }
-        }
-
-        std::array<Mino, 4> minos() const noexcept {
-            std::array<Mino, 4> global_minos = minos_;
-            for (auto&& mino : global_minos) {
-                mino.x += x;
-                mino.y += y;
-            }
-            return global_minos;
-        }
-
-        BlockStyle style() const noexcept { return style_; }
-        int8_t rotation() const noexcept { return rotation_; }
-        bool is_undef() const noexcept { return style_ == BlockStyle::Undef; }
-
-    private:
-        MinosT minos_;
-        BlockStyle style_;
-        int8_t rotation_;
-
-    private:
-        Tetromino(std::array<Mino, 4> minos_arr, BlockStyle block_style) :
-            x{ 0 },
-            y{ 0 },
-            minos_{ minos_arr },
-            style_{ block_style },
-            rotation_{ 0 }
-        {}
-
-        void rotate_I_() noexcept {
-            /**
-            *  0            1            2            3
-            *  .  .  .  .   .  . [ ] .   .  .  .  .   . [ ] .  .
-            * [ ][ ][ ][ ]  .  . [ ] .   .  .  .  .   . [ ] .  .
-            *  .  .  .  .   .  . [ ] .  [ ][ ][ ][ ]  . [ ] .  .
-            *  .  .  .  .   .  . [ ] .   .  .  .  .   . [ ] .  .
-            *  y = 0        x = 0        y = 1        x = -1
-            *  0/2=0        1/2=0        2/2=1        3/2=1
-            *  0%2=0        1%2=1        2%2=0        3%2=1
-            *  (1-0*2)*0=0  (1-1*2)*0=0  (1-0*2)*1=1  (1-1*2)*1=-1
-            */
-            int8_t rotation_div = rotation_ / 2;
-            int8_t rotation_rem = rotation_ % 2;
-            int8_t position_offset = (1 - rotation_rem * 2) * rotation_div;
-            if (rotation_ % 2) {
-                for (auto&& mino : minos_) {
-                    mino.y = -mino.x;
-                    mino.x = position_offset;
-                }
-                return;
-            }
-            for (auto&& mino : minos_) {
-                mino.x = -mino.y;
-                mino.y = position_offset;
-            }
-        }
-    };
-
-    class Tetris final {
-    public:
-        Tetris() :
-            common_wall_kick_tests_{ {
-                    {{ {0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2} }},
-                    {{ {0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2} }},
-                    {{ {0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2} }},
-                    {{ {0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2} }}
-            } },
-            I_wall_kick_tests_{ {
-                    {{ {0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2} }},
-                    {{ {0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1} }},
-                    {{ {0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2} }},
-                    {{ {0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1} }}
-            } },
-            bucket_{ { {{false}} } },
-            tetromino_{ Tetromino::Undef() },
-            next_tetromino_{ Tetromino::Undef() },
-            score_{ 0 },
-            level_{ 1 },
-            cleared_lines_{ 0 },
-            last_update_{ 0 },
-            game_speed_{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(1)).count() },
-            common_game_speed_{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(1)).count() },
-            move_direction_{ 0 },
-            rotate_{ false },
-            game_over_{ false },
-            left_key_pressed_{ false },
-            right_key_pressed_{ false },
-            rotate_key_pressed_{ false }
-        {
-            auto now = std::chrono::system_clock::now().time_since_epoch();
-            auto now_in_seconds = std::chrono::duration_cast<std::chrono::seconds>(now).count();
-            std::srand(static_cast<unsigned int>(now_in_seconds));
-            choose_next_tetromino_();
-        }
-
-        bool update(long long delta) {
-            if (game_over_) {
-                return false;
-            }
-            bool changed = false;
-            if (tetromino_.is_undef()) {
-                tetromino_ = next_tetromino_;
-                tetromino_.x = 5;
-                tetromino_.y = 1;
-                for (auto&& mino : tetromino_.minos()) {
-                    if (bucket_[mino.y][mino.x]) {
-                        game_over_ = true;
-                        return false;
-                    }
-                }
-                choose_next_tetromino_();
-                changed = true;
-            }
-            for (auto&& mino : tetromino_.minos()) {
-                bucket_[mino.y][mino.x] = false;
-            }
-            if (rotate_) {
-                changed = try_rotate_();
-                rotate_ = false;
-            }
-            if (move_direction_) {
-                changed = try_move_();
-                move_direction_ = 0;
-            }
-            last_update_ += delta;
-            bool collided = false;
-            if (last_update_ >= game_speed_) {
-                constexpr int ROWS = 20;
-                last_update_ = 0;
-                // Check for horizontal collision
-                for (auto&& mino : tetromino_.minos()) {
-                    collided |= mino.y + 1 >= ROWS || bucket_[mino.y + 1][mino.x];
-                }
-                if (!collided) {
-                    tetromino_.y += 1;
-                    changed = true;
-                }
-            }
-            for (auto&& mino : tetromino_.minos()) {
-                bucket_[mino.y][mino.x] = true;
-            }
-            if (collided) {
-                changed = try_remove_full_rows_();
-                tetromino_ = Tetromino::Undef();
-            }
-            return changed;
-        }
-
-        bool process_input() {
-            bool changed = false;
-
-            auto left_key_state = GetKeyState('7') & 0x8000;
-            if (!left_key_state) {
-                left_key_pressed_ = false;
-            }
-            else if (!left_key_pressed_ && left_key_state) {
-                move_direction_ = -1;
-                left_key_pressed_ = true;
-                changed = true;
-            }
-
-            auto right_key_state = GetKeyState('9') & 0x8000;
-            if (!right_key_state) {
-                right_key_pressed_ = false;
-            }
-            else if (!right_key_pressed_ && right_key_state) {
-                ++move_direction_ = 1;
-                right_key_pressed_ = true;
-                changed = true;
-            }
-
-            // Only right rotation supported due to comfy keyboard layout.
-            auto up_key_state = GetKeyState('8') & 0x8000;
-            if (!up_key_state) {
-                rotate_key_pressed_ = false;
-            }
-            else if (!rotate_key_pressed_ && up_key_state) {
-                rotate_ = true;
-                rotate_key_pressed_ = true;
-                changed = true;
-            }
-
-            auto down_key_state = GetKeyState('4') & 0x8000;
-            if (down_key_state) {
-                using namespace std::chrono;
-                using namespace std::chrono_literals;
-                auto speed_up_time = duration_cast<nanoseconds>(100ms).count();
-                if (speed_up_time < common_game_speed_)
-                    game_speed_ = speed_up_time;
-            }
-            else {
-                using namespace std::chrono;
-                using namespace std::chrono_literals;
-                game_speed_ = common_game_speed_;
-            }
-
-            auto reset_key_state = GetKeyState(VK_SPACE) & 0x8000;
-            if (reset_key_state) {
-                reset_();
-            }
-            return changed;
-        }
-
-        const BucketT& bucket() const& { return bucket_; }
-        const Tetromino& next_tetromino() const& { return next_tetromino_; }
-        bool game_over() const noexcept { return game_over_; }
-        size_t score() const noexcept { return score_; }
-        size_t cleared_lines() const noexcept { return cleared_lines_; }
-        size_t level() const noexcept { return level_; }
-
-    private:
-        using WallKickData = std::array<std::pair<int8_t, int8_t>, 5>;
-
-    private:
-        void reset_() {
-            for (auto&& row : bucket_) {
-                for (auto&& cell : row) {
-                    cell = false;
-                }
-            }
-            tetromino_ = Tetromino::Undef();
-            choose_next_tetromino_();
-            game_over_ = false;
-            score_ = 0;
-            level_ = 1;
-            cleared_lines_ = 0;
-            last_update_ = 0;
-            game_speed_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(1)).count();
-            common_game_speed_ = game_speed_;
-            move_direction_ = 0;
-            rotate_ = false;
-            game_over_ = false;
-            left_key_pressed_ = false;
-            right_key_pressed_ = false;
-            rotate_key_pressed_ = false;
-        }
-
-        void choose_next_tetromino_() {
-            int rand_number = std::rand() % 7;
-            switch (rand_number)
-            {
-            case 0: next_tetromino_ = Tetromino::I(); break;
-            case 1: next_tetromino_ = Tetromino::J(); break;
-            case 2: next_tetromino_ = Tetromino::L(); break;
-            case 3: next_tetromino_ = Tetromino::O(); break;
-            case 4: next_tetromino_ = Tetromino::S(); break;
-            case 5: next_tetromino_ = Tetromino::T(); break;
-            case 6: next_tetromino_ = Tetromino::Z(); break;
-            default:
-                assert("This can't happen");
-            }
-        }
-
-        // SRS rotation
-        bool try_rotate_() {
-            assert(rotate_ && "try_rotate_ is called with rotate_ other than true");
-            auto rotated_tetromino = tetromino_;
-            rotated_tetromino.rotate();
-            WallKickData* wall_kick_tests = &common_wall_kick_tests_[tetromino_.rotation()];
-            if (tetromino_.style() == Tetromino::BlockStyle::I) {
-                wall_kick_tests = &I_wall_kick_tests_[tetromino_.rotation()];
-            }
-            for (auto [x, y] : *wall_kick_tests) {
-                bool fits = true;
-                rotated_tetromino.x += x;
-                rotated_tetromino.y += y;
-                for (auto&& mino : rotated_tetromino.minos()) {
-                    constexpr int COLS = 10;
-                    constexpr int ROWS = 20;
-                    auto y = mino.y;
-                    auto x = mino.x;
-                    if (x < 0 || x >= COLS || y < 0 || y >= ROWS || bucket_[y][x]) {
-                        fits = false;
-                    }
-                }
-                if (fits) {
-                    break;
-                }
-                rotated_tetromino.x -= x;
-                rotated_tetromino.y -= y;
-            }
-            tetromino_ = rotated_tetromino;
-            return true;
-        }
-
-        bool try_move_() {
-            assert((move_direction_ == -1 || move_direction_ == 1) && "try_move_ called with move_direction_ other than 1 or -1");
-            for (auto&& mino : tetromino_.minos()) {
-                constexpr int COLS = 10;
-                int x_approximation = mino.x + move_direction_;
-                if (x_approximation < 0 || x_approximation >= COLS || bucket_[mino.y][x_approximation]) {
-                    return false;
-                }
-            }
-            tetromino_.x += move_direction_;
-            return true;
-        }
-
-        bool try_remove_full_rows_() {
-            assert(!tetromino_.is_undef() && "try_remove_full_rows_ has to be called before undefing tetromino");
-            constexpr int8_t DUMMY_ROW = 20;
-            std::array<int8_t, 4> ys = { DUMMY_ROW, DUMMY_ROW, DUMMY_ROW, DUMMY_ROW };
-            auto free_it = std::begin(ys);
-            for (auto&& mino : tetromino_.minos()) {
-                auto end = std::end(ys);
-                auto it = std::find(std::begin(ys), end, mino.y);
-                if (it == end) {
-                    *free_it = mino.y;
-                    ++free_it;
-                }
-            }
-            std::sort(std::begin(ys), std::end(ys));
-            int number_of_filled = 0;
-            for (auto y : ys) {
-                if (y == DUMMY_ROW) {
-                    break;
-                }
-                bool filled = std::all_of(std::begin(bucket_[y]), std::end(bucket_[y]), [](auto&& cell) {
-                    return cell;
-                    });
-                if (!filled) {
-                    continue;
-                }
-                ++number_of_filled;
-                for (auto&& cell : bucket_[y]) {
-                    cell = false;
-                }
-                for (; y > 0; --y) {
-                    std::swap(bucket_[y], bucket_[y - 1]);
-                }
-            }
-            // Original BPS scoring system
-            switch (number_of_filled) {
-            case 1: score_ += 40; break;
-            case 2: score_ += 100; break;
-            case 3: score_ += 300; break;
-            case 4: score_ += 1200; break;
-            }
-            auto remains_for_new_level = cleared_lines_ % 10;
-            cleared_lines_ += number_of_filled;
-            if (remains_for_new_level + number_of_filled >= 10) {
-                ++level_;
-            }
-            if (level_ <= 10) {
-                common_game_speed_ = common_game_speed_ * 4 / 5;
-            }
-            else if (level_ >= 29) {
-                using namespace std::chrono;
-                using namespace std::chrono_literals;
-                common_game_speed_ = duration_cast<nanoseconds>(20ms).count();
-            }
-            return false;
-        }
-
-    private:
-        // Wall kick rules for "right" rotations. "Left" rotations are not supported.
-        std::array<WallKickData, 4> common_wall_kick_tests_;
-        std::array<WallKickData, 4> I_wall_kick_tests_;
-        BucketT bucket_;
-        Tetromino tetromino_;
-        Tetromino next_tetromino_;
-        size_t score_;
-        size_t level_;
-        size_t cleared_lines_;
-        long long last_update_; // in ns
-        long long game_speed_; // in ns
-        long long common_game_speed_; // in ns
-        int move_direction_;
-        bool rotate_;
-        bool game_over_;
-        bool left_key_pressed_;
-        bool right_key_pressed_;
-        bool rotate_key_pressed_;
-    };
-
-    class TerminalTetrisRenderer final {
-    public:
-        TerminalTetrisRenderer() :
-            renderer_string_(
-                //     6 8    14  18   23 26 29 32 35 38 41 44 47 50                     73
-                //     | |     |   |    |  |  |  |  |  |  |  |  |  |                      |
-                "LINES CLEARED:    0 <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 0
-                "LEVEL:            1 <! .  .  .  .  .  .  .  .  .  . !> 7: left  9: right \n" // 1
-                "  SCORE:       0    <! .  .  .  .  .  .  .  .  .  . !>    8: rotate      \n" // 2
-                "                    <! .  .  .  .  .  .  .  .  .  . !>   4: speed up     \n" // 3
-                "                    <! .  .  .  .  .  .  .  .  .  . !>  space - reset    \n" // 4
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 5
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 6
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 7
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 8
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 9
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 10
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 11
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 12
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 13
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 14
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 15
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 16
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 17
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 18
-                "                    <! .  .  .  .  .  .  .  .  .  . !>                   \n" // 19
-                "                    <!==============================!>                   \n"
-                "                      \\/\\/\\/\\/\\/\\/\\/\\/\\/\\/\\/\\/\\/\\/\\/                   \n"
-            ) {
-        }
-
-        void draw_bucket(const BucketT& bucket) noexcept {
-            constexpr int ROWS = 20;
-            constexpr int COLS = 10;
-            constexpr int SCREEN_WIDTH = 74;
-            constexpr int OUTER_WIDTH = SCREEN_WIDTH - 3 * COLS;
-            constexpr int INNER_OFFSET = 22;
-            auto renderer_string_it = std::begin(renderer_string_) + INNER_OFFSET;
-            for (int i = 0; i < ROWS; ++i) {
-                for (int j = 0; j < COLS; ++j) {
-                    if (bucket[i][j]) {
-                        renderer_string_.replace(renderer_string_it, renderer_string_it + 3, "[ ]");
-                    }
-                    else {
-                        renderer_string_.replace(renderer_string_it, renderer_string_it + 3, " . ");
-                    }
-                    renderer_string_it += 3;
-                }
-                renderer_string_it += OUTER_WIDTH;
-            }
-        }
-
-        void draw_next_tetromino(const Tetromino& tetromino) {
-            constexpr int X_RANGE_BEGIN = 6;
-            constexpr int X_RANGE_END = 18;
-            constexpr int Y_RANGE_BEGIN = 11;
-            constexpr int Y_RANGE_END = 13;
-            constexpr int SCREEN_WIDTH = 74;
-            for (int i = Y_RANGE_BEGIN; i <= Y_RANGE_END; ++i) {
-                for (int j = X_RANGE_BEGIN; j <= X_RANGE_END; ++j) {
-                    renderer_string_[i * SCREEN_WIDTH + j] = ' ';
-                }
-            }
-            constexpr int CENTER_X = (X_RANGE_BEGIN + X_RANGE_END) / 2;
-            constexpr int CENTER_Y = (Y_RANGE_BEGIN + Y_RANGE_END) / 2;
-            constexpr int CENTER_IDX = CENTER_Y * SCREEN_WIDTH + CENTER_X;
-            auto it = std::begin(renderer_string_);
-            for (auto&& mino : tetromino.minos()) {
-                int idx = CENTER_IDX + 3 * mino.x + SCREEN_WIDTH * mino.y;
-                renderer_string_.replace(it + idx, it + idx + 3, "[ ]");
-            }
-        }
-
-        void draw_score(size_t score) {
-            std::stringstream score_converter;
-            score_converter << std::setw(8) << std::setfill(' ') << score;
-            constexpr size_t SCREEN_WIDTH = 74;
-            constexpr size_t SCORE_OFFSET = 8;
-            auto score_str = score_converter.str();
-            assert(score_str.length() == 8 && "Score string has to be length of 8");
-            auto renderer_string_it = std::begin(renderer_string_) + 2 * SCREEN_WIDTH + SCORE_OFFSET;
-            std::copy(std::begin(score_str), std::end(score_str), renderer_string_it);
-        }
-
-        void draw_level(size_t level) {
-            std::stringstream level_converter;
-            level_converter << std::setw(4) << std::setfill(' ') << level;
-            constexpr size_t SCREEN_WIDTH = 74;
-            constexpr size_t LEVEL_OFFSET = 15;
-            auto level_str = level_converter.str();
-            assert(level_str.length() == 4 && "Score string has to be length of 4");
-            auto renderer_string_it = std::begin(renderer_string_) + SCREEN_WIDTH + LEVEL_OFFSET;
-            std::copy(std::begin(level_str), std::end(level_str), renderer_string_it);
-        }
-
-        void draw_cleared_lines(size_t cleared_lines) {
-            std::stringstream cl_converter;
-            cl_converter << std::setw(4) << std::setfill(' ') << cleared_lines;
-            constexpr size_t SCREEN_WIDTH = 74;
-            constexpr size_t CL_OFFSET = 15;
-            auto cl_str = cl_converter.str();
-            assert(cl_str.length() == 4 && "Score string has to be length of 4");
-            auto renderer_string_it = std::begin(renderer_string_) + CL_OFFSET;
-            std::copy(std::begin(cl_str), std::end(cl_str), renderer_string_it);
-        }
-
-
-        void render() const {
-            std::cout << renderer_string_;
-        }
-
-    private:
-        std::string renderer_string_;
-    };
-}
-
-int main() {
-    Tetris t;
-    TerminalTetrisRenderer ttr;
-    auto last_update = std::chrono::high_resolution_clock::now();
-    using namespace std::chrono_literals;
-    using namespace std::chrono;
-    auto lag = 0ns;
-    while (true) {
-        auto current_update = high_resolution_clock::now();
-        auto elapsed = duration_cast<nanoseconds>(current_update - last_update);
-        last_update = current_update;
-        lag += elapsed;
-
-        bool changed = t.process_input();
-        if (t.game_over()) {
-            continue;
-        }
-        if (changed) {
-            changed = t.update(lag.count());
-            lag = 0ns;
-        }
-        constexpr auto NS_PER_UPDATE = duration_cast<nanoseconds>(16ms);
-        while (lag > NS_PER_UPDATE) {
-            changed |= t.update(NS_PER_UPDATE.count());
-            lag -= NS_PER_UPDATE;
-        }
-
-        if (changed) {
-            std::system("cls");
-            ttr.draw_next_tetromino(t.next_tetromino());
-            ttr.draw_bucket(t.bucket());
-            ttr.draw_score(t.score());
-            ttr.draw_cleared_lines(t.cleared_lines());
-            ttr.draw_level(t.level());
-            ttr.render();
-        }
-    }
-    return 0;
-}
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "bot.hpp"
+#include "handoff.hpp"
+#include "renderer.hpp"
+#include "replay.hpp"
+#include "stats.hpp"
+#include "tetris.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    enum class Key : uint8_t {
+        Left, Right, Rotate, SpeedUp, Reset, Quit
+    };
+
+    struct InputEvent final {
+        long long timestamp; // steady clock, in ns
+        Key key;
+        bool pressed;
+    };
+
+    long long steady_now() noexcept {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    using tetris::Action;
+    using tetris::Bucket;
+    using tetris::TerminalTetrisRenderer;
+    using tetris::Tetris;
+    using tetris::Tetromino;
+
+    // Turns key events into game actions. Held keys act once, when they are pressed.
+    class KeyboardController final {
+    public:
+        KeyboardController() :
+            left_key_pressed_{ false },
+            right_key_pressed_{ false },
+            rotate_key_pressed_{ false }
+        {}
+
+        // Returns whether the game state changed.
+        template <typename Game>
+        bool handle(Game& tetris, const InputEvent& event) {
+            switch (event.key) {
+            case Key::Left: return press_(tetris, left_key_pressed_, event.pressed, Action::Left);
+            case Key::Right: return press_(tetris, right_key_pressed_, event.pressed, Action::Right);
+            // Only right rotation supported due to comfy keyboard layout.
+            case Key::Rotate: return press_(tetris, rotate_key_pressed_, event.pressed, Action::RotateRight);
+            case Key::SpeedUp:
+                tetris.set_speed_up(event.pressed);
+                return false;
+            case Key::Reset:
+                if (!event.pressed) {
+                    return false;
+                }
+                tetris.reset(static_cast<uint64_t>(event.timestamp));
+                return true;
+            case Key::Quit:
+                return false;
+            }
+            return false;
+        }
+
+    private:
+        template <typename Game>
+        static bool press_(Game& tetris, bool& key_pressed, bool pressed, Action action) {
+            bool was_pressed = key_pressed;
+            key_pressed = pressed;
+            return pressed && !was_pressed && tetris.act(action);
+        }
+
+    private:
+        bool left_key_pressed_;
+        bool right_key_pressed_;
+        bool rotate_key_pressed_;
+    };
+
+    // Schedules fixed simulation ticks against absolute steady clock deadlines.
+    class TickScheduler final {
+    public:
+        TickScheduler(long long tick, int max_catch_up_ticks) :
+            tick_{ tick },
+            max_catch_up_ticks_{ max_catch_up_ticks },
+            last_tick_{ steady_now() },
+            deadline_{ -1 },
+            missed_deadlines_{ 0 },
+            dropped_ticks_{ 0 },
+            max_lateness_{ 0 }
+        {}
+
+        // Absolute deadline of the first tick on which the game state changes,
+        // given the time left until the next update is due.
+        long long next_deadline(long long time_to_next_update) noexcept {
+            auto ticks = std::max((time_to_next_update + tick_ - 1) / tick_, 1LL);
+            deadline_ = last_tick_ + ticks * tick_;
+            return deadline_;
+        }
+
+        // Splits the whole ticks elapsed up to now into update steps passed to step. Ticks up to the
+        // deadline don't change the game state in between, so they are simulated as a single step. Late
+        // ticks are simulated one by one, at most max_catch_up_ticks of them; the rest is dropped so a
+        // descheduled process doesn't spiral trying to catch up.
+        template <typename Step>
+        void advance(long long now, Step&& step) {
+            auto ticks = (now - last_tick_) / tick_;
+            if (ticks <= 0) {
+                return;
+            }
+            auto planned_ticks = deadline_ >= 0 ? std::max((deadline_ - last_tick_) / tick_, 1LL) : 1LL;
+            auto first_ticks = std::min(ticks, planned_ticks);
+            step(first_ticks * tick_);
+            last_tick_ += first_ticks * tick_;
+            ticks -= first_ticks;
+            if (deadline_ >= 0 && now >= deadline_) {
+                auto lateness = now - deadline_;
+                max_lateness_ = std::max(max_lateness_, lateness);
+                if (lateness >= tick_) {
+                    ++missed_deadlines_;
+                }
+                deadline_ = -1;
+            }
+            last_tick_ += ticks * tick_;
+            if (ticks > max_catch_up_ticks_) {
+                dropped_ticks_ += ticks - max_catch_up_ticks_;
+                ticks = max_catch_up_ticks_;
+            }
+            for (; ticks > 0; --ticks) {
+                step(tick_);
+            }
+        }
+
+        // Restarts the tick phase at now, returning the time elapsed since the last tick.
+        long long rebase(long long now) noexcept {
+            auto elapsed = now - last_tick_;
+            last_tick_ = now;
+            deadline_ = -1;
+            return elapsed;
+        }
+
+        size_t missed_deadlines() const noexcept { return missed_deadlines_; }
+        size_t dropped_ticks() const noexcept { return dropped_ticks_; }
+        long long max_lateness() const noexcept { return max_lateness_; }
+
+    private:
+        long long tick_; // in ns
+        int max_catch_up_ticks_;
+        long long last_tick_; // in ns
+        long long deadline_; // in ns, negative if not waiting for one
+        size_t missed_deadlines_;
+        size_t dropped_ticks_;
+        long long max_lateness_; // in ns
+    };
+
+#ifdef _WIN32
+    // Console input backend: blocks on the console handle and reports key downs/ups as they arrive.
+    class ConsoleInput final {
+    public:
+        ConsoleInput() : handle_{ GetStdHandle(STD_INPUT_HANDLE) } {}
+
+        // Waits for input until the steady clock deadline (forever if negative) and passes decoded events to handler.
+        template <typename Handler>
+        void wait_until(long long deadline, Handler&& handler) {
+            DWORD timeout_ms = INFINITE;
+            if (deadline >= 0) {
+                auto timeout = std::max(deadline - steady_now(), 0LL);
+                timeout_ms = static_cast<DWORD>((timeout + 999'999) / 1'000'000);
+            }
+            if (WaitForSingleObject(handle_, timeout_ms) != WAIT_OBJECT_0) {
+                return;
+            }
+            std::array<INPUT_RECORD, 32> records;
+            DWORD count = 0;
+            if (!ReadConsoleInput(handle_, records.data(), static_cast<DWORD>(records.size()), &count)) {
+                return;
+            }
+            auto now = steady_now();
+            for (DWORD i = 0; i < count; ++i) {
+                if (records[i].EventType != KEY_EVENT) {
+                    continue;
+                }
+                const auto& key_event = records[i].Event.KeyEvent;
+                Key key;
+                switch (key_event.wVirtualKeyCode) {
+                case '7': key = Key::Left; break;
+                case '9': key = Key::Right; break;
+                case '8': key = Key::Rotate; break;
+                case '4': key = Key::SpeedUp; break;
+                case VK_SPACE: key = Key::Reset; break;
+                case 'Q': key = Key::Quit; break;
+                default: continue;
+                }
+                handler(InputEvent{ now, key, key_event.bKeyDown != FALSE });
+            }
+        }
+
+    private:
+        HANDLE handle_;
+    };
+
+    using PlatformInput = ConsoleInput;
+#else
+    // Raw-mode terminal input backend. Terminals report key presses only, so releases are synthesized:
+    // discrete keys are released right after being pressed, speed up is held while it autorepeats.
+    class TerminalInput final {
+    public:
+        TerminalInput() :
+            timer_fd_{ timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC) },
+            speed_up_release_{ 0 },
+            speed_up_held_{ false },
+            stdin_open_{ true }
+        {
+            tcgetattr(STDIN_FILENO, &saved_attributes_);
+            auto attributes = saved_attributes_;
+            attributes.c_lflag &= ~(ICANON | ECHO | ISIG);
+            attributes.c_cc[VMIN] = 0;
+            attributes.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSANOW, &attributes);
+        }
+
+        TerminalInput(const TerminalInput&) = delete;
+        TerminalInput& operator=(const TerminalInput&) = delete;
+
+        ~TerminalInput() {
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved_attributes_);
+            close(timer_fd_);
+        }
+
+        // Waits for input until the steady clock deadline (forever if negative) and passes decoded events to handler.
+        // The deadline is armed as an absolute CLOCK_MONOTONIC timer, so it doesn't drift with the time spent here.
+        template <typename Handler>
+        void wait_until(long long deadline, Handler&& handler) {
+            if (speed_up_held_) {
+                deadline = deadline < 0 ? speed_up_release_ : std::min(deadline, speed_up_release_);
+            }
+            itimerspec timer{};
+            if (deadline >= 0) {
+                // A zero it_value disarms the timer, so an overdue deadline becomes the earliest possible one.
+                auto expiration = std::max(deadline, 1LL);
+                timer.it_value.tv_sec = static_cast<time_t>(expiration / 1'000'000'000);
+                timer.it_value.tv_nsec = static_cast<long>(expiration % 1'000'000'000);
+            }
+            timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &timer, nullptr);
+            std::array<pollfd, 2> fds = { {
+                { stdin_open_ ? STDIN_FILENO : -1, POLLIN, 0 },
+                { timer_fd_, POLLIN, 0 }
+            } };
+            if (poll(fds.data(), fds.size(), -1) <= 0) {
+                return;
+            }
+            auto now = steady_now();
+            if (fds[1].revents & POLLIN) {
+                uint64_t expirations;
+                read(timer_fd_, &expirations, sizeof(expirations));
+            }
+            if (fds[0].revents & (POLLIN | POLLHUP)) {
+                std::array<char, 64> buffer;
+                auto count = read(STDIN_FILENO, buffer.data(), buffer.size());
+                stdin_open_ = count != 0;
+                for (decltype(count) i = 0; i < count; ++i) {
+                    decode(buffer[i], now, handler);
+                }
+            }
+            if (speed_up_held_ && now >= speed_up_release_) {
+                speed_up_held_ = false;
+                handler(InputEvent{ now, Key::SpeedUp, false });
+            }
+        }
+
+        // Turns a single byte read from the terminal into key events.
+        template <typename Handler>
+        void decode(char byte, long long timestamp, Handler&& handler) {
+            // Longer than a typical autorepeat delay, so holding the key doesn't flicker.
+            constexpr long long SPEED_UP_RELEASE_DELAY = 600'000'000;
+            Key key;
+            switch (byte) {
+            case '7': key = Key::Left; break;
+            case '9': key = Key::Right; break;
+            case '8': key = Key::Rotate; break;
+            case '4': key = Key::SpeedUp; break;
+            case ' ': key = Key::Reset; break;
+            case 'q': case '\x03': key = Key::Quit; break;
+            default: return;
+            }
+            if (key == Key::SpeedUp) {
+                speed_up_release_ = timestamp + SPEED_UP_RELEASE_DELAY;
+                if (!speed_up_held_) {
+                    speed_up_held_ = true;
+                    handler(InputEvent{ timestamp, key, true });
+                }
+                return;
+            }
+            handler(InputEvent{ timestamp, key, true });
+            handler(InputEvent{ timestamp, key, false });
+        }
+
+    private:
+        termios saved_attributes_;
+        int timer_fd_;
+        long long speed_up_release_; // in ns
+        bool speed_up_held_;
+        bool stdin_open_;
+    };
+
+    using PlatformInput = TerminalInput;
+#endif
+
+    struct Options final {
+        bool bot = false;
+        const char* record = nullptr;
+        const char* replay = nullptr;
+        bool fast = false;
+        bool threaded = false;
+        bool stats = false;
+        const char* stats_file = nullptr;
+        const char* trace = nullptr;
+    };
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "--bot") {
+                options.bot = true;
+            }
+            else if (option == "--fast") {
+                options.fast = true;
+            }
+            else if (option == "--threaded") {
+                options.threaded = true;
+            }
+            else if (option == "--stats") {
+                options.stats = true;
+            }
+            else if ((option == "--record" || option == "--replay") && i + 1 < argc) {
+                (option == "--record" ? options.record : options.replay) = argv[++i];
+            }
+            else if ((option == "--stats-file" || option == "--trace") && i + 1 < argc) {
+                (option == "--stats-file" ? options.stats_file : options.trace) = argv[++i];
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [--bot] [--record FILE] [--threaded] [--stats] [--stats-file FILE] [--trace FILE] | --replay FILE [--fast]\n";
+                return false;
+            }
+        }
+        if ((options.stats || options.stats_file) && !tetris::stats::ENABLED) {
+            std::cerr << "Statistics need a build with TETRIS_STATS defined\n";
+            return false;
+        }
+        if (options.trace && !tetris::trace::ENABLED) {
+            std::cerr << "Tracing needs a build with TETRIS_TRACE defined\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Set by SIGUSR1 to export the trace without quitting.
+    std::atomic<bool> trace_requested{ false };
+
+    template <typename Game>
+    void draw(TerminalTetrisRenderer& ttr, const Game& t) {
+        using tetris::stats::Metric;
+        {
+            tetris::stats::ScopedTimer timer{ Metric::DrawTime };
+            ttr.draw_game(t);
+        }
+        tetris::stats::ScopedTimer timer{ Metric::RenderTime };
+        tetris::stats::record(Metric::RenderBytes, ttr.render());
+        tetris::stats::count(tetris::stats::Counter::Frames);
+    }
+
+    // Formats a duration in ns with a unit that keeps it short.
+    void format_duration(char* buffer, size_t size, uint64_t ns) {
+        if (ns < 1'000) {
+            std::snprintf(buffer, size, "%lluns", static_cast<unsigned long long>(ns));
+        }
+        else if (ns < 1'000'000) {
+            std::snprintf(buffer, size, "%.1fus", ns / 1e3);
+        }
+        else {
+            std::snprintf(buffer, size, "%.1fms", ns / 1e6);
+        }
+    }
+
+    // Shows the median and the 99th percentile of every metric next to the bucket.
+    void draw_stats(TerminalTetrisRenderer& ttr) {
+        using tetris::stats::Metric;
+        constexpr std::pair<const char*, Metric> ROWS[] = {
+            { "tick", Metric::TickTime },
+            { "catchup", Metric::CatchUpTicks },
+            { "draw", Metric::DrawTime },
+            { "render", Metric::RenderTime },
+            { "bytes", Metric::RenderBytes },
+            { "input", Metric::InputLatency }
+        };
+        ttr.draw_overlay(0, "STATS     p50   p99");
+        int line = 1;
+        for (auto [name, metric] : ROWS) {
+            auto summary = tetris::stats::summary(metric);
+            std::array<char, 16> p50;
+            std::array<char, 16> p99;
+            if (metric == Metric::CatchUpTicks || metric == Metric::RenderBytes) {
+                std::snprintf(p50.data(), p50.size(), "%llu", static_cast<unsigned long long>(summary.p50));
+                std::snprintf(p99.data(), p99.size(), "%llu", static_cast<unsigned long long>(summary.p99));
+            }
+            else {
+                format_duration(p50.data(), p50.size(), summary.p50);
+                format_duration(p99.data(), p99.size(), summary.p99);
+            }
+            std::array<char, 48> text;
+            std::snprintf(text.data(), text.size(), "%-7s%6s%6s", name, p50.data(), p99.data());
+            ttr.draw_overlay(line++, text.data());
+        }
+    }
+
+    // Writes the statistics to the file and the overlay every STATS_INTERVAL, if asked to.
+    class StatsReport final {
+    public:
+        StatsReport(bool overlay, std::FILE* file) :
+            overlay_{ overlay },
+            file_{ file },
+            start_{ steady_now() },
+            next_{ start_ + STATS_INTERVAL }
+        {}
+
+        // Steady clock time of the next report in ns, -1 if there are none.
+        long long next_time() const noexcept { return tetris::stats::ENABLED && (overlay_ || file_) ? next_ : -1; }
+
+        // Reports if it's time to. Returns whether the overlay changed.
+        bool update(TerminalTetrisRenderer& ttr, long long now) {
+            if (!tetris::stats::ENABLED || (!overlay_ && !file_) || now < next_) {
+                return false;
+            }
+            if (file_) {
+                tetris::stats::dump(file_, (now - start_) / 1e9);
+            }
+            if (overlay_) {
+                draw_stats(ttr);
+            }
+            next_ = now + STATS_INTERVAL;
+            return overlay_;
+        }
+
+        void finish() {
+            if (file_) {
+                tetris::stats::dump(file_, (steady_now() - start_) / 1e9);
+                std::fclose(file_);
+                file_ = nullptr;
+            }
+        }
+
+    private:
+        static constexpr long long STATS_INTERVAL = 1'000'000'000; // in ns
+
+    private:
+        bool overlay_;
+        std::FILE* file_;
+        long long start_;
+        long long next_;
+    };
+
+    // Advances the game by key events, ticks and the moves of the bot if it plays. The game loop drives it,
+    // or the simulation thread does when frames are rendered on their own thread.
+    class Simulation final {
+    public:
+        Simulation(tetris::RecordingTetris& game, bool bot, uint64_t seed) :
+            game_{ game },
+            scheduler_{ tetris::NS_PER_TICK, MAX_CATCH_UP_TICKS },
+            pool_{ bot ? std::max(std::thread::hardware_concurrency(), 1u) : 1 },
+            bot_{ pool_, tetris::BotConfig{ 8, game.game().preview_depth() + 1, {} } },
+            plays_bot_{ bot },
+            seed_{ seed },
+            bot_pieces_{ 0 },
+            bot_games_{ 1 },
+            bot_time_{ 0 },
+            changed_{ false },
+            unshown_key_press_{ -1 },
+            shown_key_press_{ -1 }
+        {}
+
+        const Tetris& game() const noexcept { return game_.game(); }
+
+        // Steady clock time of the first tick on which the tetromino moves, -1 if the game is over.
+        long long next_deadline() noexcept {
+            return game().game_over() ? -1 : scheduler_.next_deadline(game().time_to_next_update());
+        }
+
+        void handle(const InputEvent& event) {
+            tetris::trace::Span span{ "process_input" };
+            game_.set_time(event.timestamp);
+            bool handled = controller_.handle(game_, event);
+            if (tetris::stats::ENABLED && event.pressed) {
+                tetris::stats::count(tetris::stats::Counter::KeyPresses);
+                if (unshown_key_press_ == shown_key_press_.load(std::memory_order_relaxed)) {
+                    unshown_key_press_ = -1;
+                }
+                if (handled && unshown_key_press_ < 0) {
+                    unshown_key_press_ = event.timestamp;
+                }
+            }
+            changed_ |= handled;
+        }
+
+        // Runs the ticks elapsed up to now and lets the bot move.
+        void advance(long long now) {
+            game_.set_time(now);
+            if (game().game_over() && plays_bot_) {
+                game_.reset(++seed_);
+                ++bot_games_;
+            }
+            if (game().game_over()) {
+                scheduler_.rebase(now);
+                return;
+            }
+            uint64_t steps = 0;
+            auto dropped_ticks = scheduler_.dropped_ticks();
+            scheduler_.advance(now, [&](long long delta) {
+                tetris::trace::Span span{ "update" };
+                tetris::stats::ScopedTimer timer{ tetris::stats::Metric::TickTime };
+                changed_ |= game_.update(delta);
+                ++steps;
+            });
+            if (steps) {
+                tetris::stats::record(tetris::stats::Metric::CatchUpTicks, steps);
+                tetris::stats::count(tetris::stats::Counter::Ticks, steps);
+                tetris::stats::count(tetris::stats::Counter::DroppedTicks, scheduler_.dropped_ticks() - dropped_ticks);
+            }
+            if (plays_bot_ && !game().game_over() && !game().tetromino().is_undef()) {
+                tetris::trace::Span span{ "bot" };
+                auto started = steady_now();
+                auto tetromino = bot_.choose(game());
+                bot_time_ += steady_now() - started;
+                if (!tetromino.is_undef()) {
+                    tetris::trace::Span lock_span{ "lock" };
+                    changed_ |= game_.lock(tetromino);
+                    ++bot_pieces_;
+                }
+            }
+        }
+
+        // Returns whether the game changed since the last call.
+        bool take_changed() noexcept {
+            bool changed = changed_;
+            changed_ = false;
+            return changed;
+        }
+
+        // Time of the oldest key press that changed the game and isn't on screen yet, -1 if none.
+        long long unshown_key_press() const noexcept {
+            return unshown_key_press_ == shown_key_press_.load(std::memory_order_relaxed) ? -1 : unshown_key_press_;
+        }
+
+        // Tells that a frame with the key press is on screen. The render thread may call it.
+        void shown(long long key_press) noexcept { shown_key_press_.store(key_press, std::memory_order_relaxed); }
+
+        void report() const {
+            std::cerr << "Missed deadlines: " << scheduler_.missed_deadlines()
+                << ", dropped ticks: " << scheduler_.dropped_ticks()
+                << ", max lateness: " << scheduler_.max_lateness() / 1000 << " us\n";
+            if (plays_bot_) {
+                std::cerr << "Bot: " << bot_pieces_ << " pieces in " << bot_games_ << " games, "
+                    << static_cast<long long>(bot_.evaluated_placements() * 1e9 / std::max(bot_time_, 1LL)) << " placements/s on "
+                    << pool_.size() << " threads\n";
+            }
+        }
+
+    private:
+        static constexpr int MAX_CATCH_UP_TICKS = 4;
+
+    private:
+        tetris::RecordingTetris& game_;
+        KeyboardController controller_;
+        TickScheduler scheduler_;
+        tetris::ThreadPool pool_;
+        tetris::BeamSearchBot bot_;
+        bool plays_bot_;
+        uint64_t seed_;
+        size_t bot_pieces_;
+        size_t bot_games_;
+        long long bot_time_; // in ns
+        bool changed_;
+        long long unshown_key_press_;
+        std::atomic<long long> shown_key_press_;
+    };
+
+    // What the screen shows of a game, handed from the simulation thread to the render thread.
+    class GameSnapshot final {
+    public:
+        GameSnapshot() :
+            bucket_{},
+            previews_{},
+            preview_depth_{ 0 },
+            score_{ 0 },
+            level_{ 1 },
+            cleared_lines_{ 0 },
+            key_press_{ -1 }
+        {}
+
+        void assign(const Tetris& game, long long key_press) noexcept {
+            bucket_ = game.bucket();
+            preview_depth_ = std::min(game.preview_depth(), previews_.size());
+            for (size_t i = 0; i < preview_depth_; ++i) {
+                previews_[i] = game.preview(i).style();
+            }
+            score_ = game.score();
+            level_ = game.level();
+            cleared_lines_ = game.cleared_lines();
+            key_press_ = key_press;
+        }
+
+        // The part of the Tetris interface TerminalTetrisRenderer::draw_game() reads.
+        const Bucket& bucket() const noexcept { return bucket_; }
+        size_t preview_depth() const noexcept { return preview_depth_; }
+        Tetromino preview(size_t i) const noexcept { return Tetromino{ previews_[i] }; }
+        size_t score() const noexcept { return score_; }
+        size_t level() const noexcept { return level_; }
+        size_t cleared_lines() const noexcept { return cleared_lines_; }
+        // Oldest key press first shown by the snapshot, -1 if none.
+        long long key_press() const noexcept { return key_press_; }
+
+    private:
+        Bucket bucket_;
+        std::array<tetris::BlockStyle, TerminalTetrisRenderer::PREVIEW_SLOTS> previews_;
+        size_t preview_depth_;
+        size_t score_;
+        size_t level_;
+        size_t cleared_lines_;
+        long long key_press_;
+    };
+
+    void export_requested_trace(const Options& options) {
+        if (options.trace && trace_requested.exchange(false, std::memory_order_relaxed)) {
+            tetris::trace::export_json(options.trace);
+        }
+    }
+
+    // Input, simulation and rendering take turns on the calling thread.
+    void play(Simulation& simulation, StatsReport& stats, const Options& options) {
+        TerminalTetrisRenderer ttr;
+        PlatformInput input;
+        bool running = true;
+        while (running) {
+            // Sleep until a key is pressed or the tick on which the tetromino has to move.
+            input.wait_until(simulation.next_deadline(), [&](const InputEvent& event) {
+                if (event.key == Key::Quit) {
+                    running = false;
+                }
+                simulation.handle(event);
+            });
+            auto now = steady_now();
+            export_requested_trace(options);
+            simulation.advance(now);
+            bool changed = stats.update(ttr, now);
+            if (simulation.take_changed() || changed) {
+                draw(ttr, simulation.game());
+                auto key_press = simulation.unshown_key_press();
+                if (key_press >= 0) {
+                    tetris::stats::record(tetris::stats::Metric::InputLatency, static_cast<uint64_t>(steady_now() - key_press));
+                    simulation.shown(key_press);
+                }
+            }
+        }
+    }
+
+    // The calling thread reads input and passes it through a ring to the simulation thread, which publishes
+    // snapshots of the game to the render thread. A slow terminal delays only the frames, the simulation
+    // keeps its ticks, and frames that are stale by the time they could be drawn are dropped.
+    void play_threaded(Simulation& simulation, StatsReport& stats, const Options& options) {
+        constexpr size_t INPUT_CAPACITY = 256;
+        tetris::SpscRing<InputEvent, INPUT_CAPACITY> inputs;
+        tetris::TripleBuffer<GameSnapshot> frames;
+        tetris::Wakeup simulation_wakeup;
+        tetris::Wakeup render_wakeup;
+        std::atomic<bool> stopping{ false };
+
+        std::thread simulation_thread{ [&] {
+            while (!stopping.load(std::memory_order_acquire)) {
+                simulation_wakeup.wait_until(simulation.next_deadline());
+                InputEvent event;
+                while (inputs.pop(event)) {
+                    simulation.handle(event);
+                }
+                simulation.advance(steady_now());
+                if (simulation.take_changed()) {
+                    frames.back().assign(simulation.game(), simulation.unshown_key_press());
+                    frames.publish();
+                    render_wakeup.notify();
+                }
+            }
+        } };
+
+        std::thread render_thread{ [&] {
+            TerminalTetrisRenderer ttr;
+            long long last_key_press = -1;
+            while (!stopping.load(std::memory_order_acquire)) {
+                render_wakeup.wait_until(stats.next_time());
+                bool changed = frames.update();
+                changed |= stats.update(ttr, steady_now());
+                if (!changed) {
+                    continue;
+                }
+                const auto& snapshot = frames.front();
+                draw(ttr, snapshot);
+                // Snapshots carry the oldest unshown key press until a frame with it is on screen.
+                if (snapshot.key_press() >= 0 && snapshot.key_press() != last_key_press) {
+                    last_key_press = snapshot.key_press();
+                    tetris::stats::record(tetris::stats::Metric::InputLatency, static_cast<uint64_t>(steady_now() - last_key_press));
+                    simulation.shown(last_key_press);
+                }
+            }
+        } };
+
+        PlatformInput input;
+        bool running = true;
+        while (running) {
+            input.wait_until(-1, [&](const InputEvent& event) {
+                if (event.key == Key::Quit) {
+                    running = false;
+                    return;
+                }
+                while (!inputs.push(event)) {
+                    std::this_thread::yield();
+                }
+                simulation_wakeup.notify();
+            });
+            export_requested_trace(options);
+        }
+        stopping.store(true, std::memory_order_release);
+        simulation_wakeup.notify();
+        render_wakeup.notify();
+        simulation_thread.join();
+        render_thread.join();
+    }
+
+    // Shows a recorded game at the speed it was played, or only its outcome when fast.
+    int play_replay(const char* path, bool fast) {
+        tetris::MappedFile file;
+        if (!file.open(path)) {
+            std::cerr << "Can't read " << path << "\n";
+            return 1;
+        }
+        // Keyframes only pay off when seeking, which playing straight through doesn't.
+        tetris::ReplayPlayer player{ file.data(), file.size(), 0 };
+        if (fast) {
+            while (player.step()) {}
+        }
+        else {
+            TerminalTetrisRenderer ttr;
+            PlatformInput input;
+            auto start = steady_now();
+            bool running = true;
+            draw(ttr, player.game());
+            while (running) {
+                // Sleep until the next event is due, or a key is pressed after the last one.
+                long long next_event;
+                long long deadline = player.next_time(next_event) ? start + next_event : -1;
+                input.wait_until(deadline, [&](const InputEvent& event) {
+                    running &= event.key != Key::Quit;
+                });
+                auto applied = player.events();
+                player.fast_forward(steady_now() - start);
+                if (player.events() != applied) {
+                    draw(ttr, player.game());
+                }
+            }
+        }
+        const auto& game = player.game();
+        std::cerr << "Replayed " << player.events() << " events over " << player.time() / 1'000'000 << " ms: score "
+            << game.score() << ", lines " << game.cleared_lines() << ", level " << game.level() << "\n";
+        if (player.corrupt()) {
+            std::cerr << path << " is corrupt\n";
+            return 1;
+        }
+        return 0;
+    }
+}
+
+// With --bot the game plays itself and starts over when it's lost, keys still work. --threaded runs
+// the simulation and the rendering on threads of their own.
+// --record saves the game to a replay file, --replay shows one, or only prints its outcome with --fast.
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    if (options.replay) {
+        return play_replay(options.replay, options.fast);
+    }
+    auto now_in_seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    auto seed = static_cast<uint64_t>(now_in_seconds);
+    constexpr size_t PREVIEW_DEPTH = 3;
+    static_assert(PREVIEW_DEPTH <= TerminalTetrisRenderer::PREVIEW_SLOTS, "Previews don't fit the screen");
+    Tetris t{ seed, PREVIEW_DEPTH };
+    tetris::ReplayWriter writer;
+    if (options.record && !writer.open(options.record, seed, PREVIEW_DEPTH, steady_now())) {
+        std::cerr << "Can't create " << options.record << "\n";
+        return 1;
+    }
+    std::FILE* stats_file = options.stats_file ? std::fopen(options.stats_file, "w") : nullptr;
+    if (options.stats_file && !stats_file) {
+        std::cerr << "Can't create " << options.stats_file << "\n";
+        return 1;
+    }
+#ifndef _WIN32
+    if (options.trace) {
+        std::signal(SIGUSR1, [](int) { trace_requested.store(true, std::memory_order_relaxed); });
+    }
+#endif
+    tetris::RecordingTetris game{ t, writer };
+    Simulation simulation{ game, options.bot, seed };
+    StatsReport stats{ options.stats, stats_file };
+    if (options.threaded) {
+        play_threaded(simulation, stats, options);
+    }
+    else {
+        play(simulation, stats, options);
+    }
+    if (options.trace && !tetris::trace::export_json(options.trace)) {
+        std::cerr << "Can't write " << options.trace << "\n";
+    }
+    stats.finish();
+    simulation.report();
+    if (!writer.close()) {
+        std::cerr << "Can't write " << options.record << "\n";
+        return 1;
+    }
+    return 0;
+}
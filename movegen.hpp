@@ -0,0 +1,177 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+#include "tetris.hpp"
+
+namespace tetris {
+
+    // Position a tetromino locks at.
+    struct Placement final {
+        int8_t x;
+        int8_t y;
+        int8_t rotation;
+    };
+
+    // Enumerates every position a tetromino can lock at, reachable from where it is by moving, rotating
+    // with SRS wall kicks and falling, so tucks and spins are included. Placements that cover the same
+    // cells in different rotations are reported once.
+    //
+    // Positions are kept as bitsets over y, one per (rotation, x), so falling through a column,
+    // sliding and kicking handle all rows of a column at once instead of one position at a time.
+    class PlacementGenerator final {
+    public:
+        // Calls visit(const Placement&) for every lock position. The bucket must not contain the tetromino.
+        template <typename Visitor>
+        void generate(const Bucket& bucket, const Tetromino& tetromino, Visitor&& visit) {
+            assert(bucket.fits(tetromino) && "Tetromino doesn't fit the bucket");
+            style_ = tetromino.style();
+            for (int8_t rotation = 0; rotation < 4; ++rotation) {
+                kick_tests_[rotation] = { &Tetromino{ style_, rotation }.wall_kick_tests(1), &Tetromino{ style_, rotation }.wall_kick_tests(-1) };
+            }
+            compute_fits_(bucket);
+            reached_ = {};
+            pending_ = {};
+            pending_columns_ = {};
+            reach_(tetromino.rotation(), tetromino.x + X_OFFSET, bit_(tetromino.y));
+            // Rotations are drained one at a time, so a column is mostly expanded after it's been reached
+            // from both sides instead of once per side.
+            for (bool expanded = true; expanded;) {
+                expanded = false;
+                for (int rotation = 0; rotation < 4; ++rotation) {
+                    while (auto columns = pending_columns_[rotation]) {
+                        int column = __builtin_ctz(columns);
+                        pending_columns_[rotation] &= columns - 1;
+                        auto positions = pending_[rotation][column];
+                        pending_[rotation][column] = 0;
+                        expand_(rotation, column, positions);
+                        expanded = true;
+                    }
+                }
+            }
+            report_(visit);
+        }
+
+    private:
+        // Positions are stored in a column of bits, bit y + Y_OFFSET for row y, and columns are indexed by
+        // x + X_OFFSET. A tetromino inside the bucket has its x in [0, COLS] and kicks move it by up to
+        // 2 cells, so columns never need bounds checks.
+        using ColumnT = uint32_t;
+        static constexpr int X_OFFSET = 2;
+        static constexpr int Y_OFFSET = 2;
+        static constexpr int X_SPAN = Bucket::COLS + 1 + 2 * X_OFFSET;
+        static_assert(Bucket::ROWS + 2 * Y_OFFSET <= 32, "Bucket rows don't fit a column of positions");
+
+        // Occupancy of a bucket column with walls around, bit row + WALL_ROWS for a row of the bucket.
+        using WallColumnT = uint64_t;
+        static constexpr int WALL_ROWS = Y_OFFSET + 2;
+
+    private:
+        static constexpr ColumnT bit_(int y) noexcept { return ColumnT{ 1 } << (y + Y_OFFSET); }
+
+        // Shifts positions dy rows down, up if dy is negative.
+        static constexpr ColumnT shift_(ColumnT positions, int dy) noexcept {
+            return dy >= 0 ? positions << dy : positions >> -dy;
+        }
+
+        // Every position that falls from the seeds without a collision, seeds included.
+        // Adding the seeds carries through the runs of free positions below them, clearing exactly those.
+        static constexpr ColumnT fall_(ColumnT seeds, ColumnT free) noexcept {
+            return free & (~(free + seeds) | seeds);
+        }
+
+        void compute_fits_(const Bucket& bucket) noexcept {
+            // Floor and ceiling rows are occupied.
+            constexpr WallColumnT EMPTY_COLUMN = ~(((WallColumnT{ 1 } << Bucket::ROWS) - 1) << WALL_ROWS);
+            std::array<WallColumnT, Bucket::COLS> walls;
+            walls.fill(EMPTY_COLUMN);
+            for (int y = 0; y < Bucket::ROWS; ++y) {
+                auto row = bucket.row(y);
+                for (; row; row &= row - 1) {
+                    int x = __builtin_ctz(row);
+                    walls[x] |= WallColumnT{ 1 } << (y + WALL_ROWS);
+                }
+            }
+            // Only columns keeping the tetromino between the side walls can fit, and there a mino at (dx, dy)
+            // of a tetromino at row y lands on bit y + dy + WALL_ROWS of its bucket column.
+            for (int rotation = 0; rotation < 4; ++rotation) {
+                const auto& shape = SHAPES[static_cast<unsigned>(style_)][rotation];
+                fits_[rotation].fill(0);
+                for (int x = -shape.left; x + shape.left + shape.width <= Bucket::COLS; ++x) {
+                    WallColumnT collisions = 0;
+                    for (auto&& mino : shape.minos) {
+                        collisions |= walls[x + mino.x] >> (mino.y + WALL_ROWS - Y_OFFSET);
+                    }
+                    fits_[rotation][x + X_OFFSET] = static_cast<ColumnT>(~collisions);
+                }
+            }
+        }
+
+        void reach_(int rotation, int column, ColumnT positions) noexcept {
+            assert(column >= 0 && column < X_SPAN && "Column is out of range");
+            // Branchless, whether a move reaches anything new is hard to predict.
+            positions = fall_(positions & fits_[rotation][column], fits_[rotation][column]) & ~reached_[rotation][column];
+            reached_[rotation][column] |= positions;
+            pending_[rotation][column] |= positions;
+            pending_columns_[rotation] |= static_cast<uint32_t>(positions != 0) << column;
+        }
+
+        void expand_(int rotation, int column, ColumnT positions) noexcept {
+            reach_(rotation, column - 1, positions);
+            reach_(rotation, column + 1, positions);
+            for (int direction : { 1, -1 }) {
+                int rotated = (rotation + 4 + direction) % 4;
+                // The first kick test that fits wins, so each test only gets the positions all previous ones failed.
+                auto remaining = positions;
+                for (auto [dx, dy] : *kick_tests_[rotation][direction < 0]) {
+                    if (!remaining) {
+                        break;
+                    }
+                    int kicked_column = column + dx;
+                    auto kicked = remaining & shift_(fits_[rotated][kicked_column], -dy);
+                    remaining &= ~kicked;
+                    reach_(rotated, kicked_column, shift_(kicked, dy));
+                }
+            }
+        }
+
+        template <typename Visitor>
+        void report_(Visitor&& visit) {
+            const auto& shapes = SHAPES[static_cast<unsigned>(style_)];
+            std::array<std::array<ColumnT, X_SPAN>, 4> reported{};
+            for (int rotation = 0; rotation < 4; ++rotation) {
+                // Rotations covering the same cells as an earlier one are reported at its positions.
+                int same = 0;
+                while (shapes[same].row_masks != shapes[rotation].row_masks
+                    || shapes[same].width != shapes[rotation].width
+                    || shapes[same].height != shapes[rotation].height) {
+                    ++same;
+                }
+                int dx = shapes[rotation].left - shapes[same].left;
+                int dy = shapes[rotation].top - shapes[same].top;
+                for (int column = 0; column < X_SPAN; ++column) {
+                    auto locks = reached_[rotation][column] & ~(fits_[rotation][column] >> 1);
+                    for (; locks; locks &= locks - 1) {
+                        int y = __builtin_ctz(locks) - Y_OFFSET;
+                        auto& same_reported = reported[same][column + dx];
+                        if (same_reported & bit_(y + dy)) {
+                            continue;
+                        }
+                        same_reported |= bit_(y + dy);
+                        visit(Placement{ static_cast<int8_t>(column - X_OFFSET), static_cast<int8_t>(y), static_cast<int8_t>(rotation) });
+                    }
+                }
+            }
+        }
+
+    private:
+        Tetromino::BlockStyle style_;
+        std::array<std::array<const WallKickData*, 2>, 4> kick_tests_;
+        std::array<std::array<ColumnT, X_SPAN>, 4> fits_;
+        std::array<std::array<ColumnT, X_SPAN>, 4> reached_;
+        std::array<std::array<ColumnT, X_SPAN>, 4> pending_;
+        std::array<uint32_t, 4> pending_columns_; // bit column is set if pending_[rotation][column] isn't empty
+    };
+}
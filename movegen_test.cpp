@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "movegen.hpp"
+#include "tetris.hpp"
+
+// Checks PlacementGenerator against a naive search that moves, rotates with wall kicks and drops a tetromino
+// one position at a time through Bucket::fits: both must find the same set of lock positions, each reported
+// once, on random boards for every piece.
+//
+// Usage: tetris-movegen-test [BOARDS]
+
+namespace {
+
+    using tetris::Bucket;
+    using tetris::Tetromino;
+
+    // Cells a locked tetromino covers, so rotations covering the same cells compare equal.
+    using Cells = std::array<std::pair<int, int>, 4>;
+
+    Cells cells_of(const Tetromino& tetromino) {
+        Cells cells;
+        auto minos = tetromino.minos();
+        for (size_t i = 0; i < cells.size(); ++i) {
+            cells[i] = { minos[i].x, minos[i].y };
+        }
+        std::sort(cells.begin(), cells.end());
+        return cells;
+    }
+
+    std::set<Cells> search(const Bucket& bucket, const Tetromino& spawned) {
+        std::set<std::tuple<int, int, int>> seen{ { spawned.x, spawned.y, spawned.rotation() } };
+        std::vector<Tetromino> pending{ spawned };
+        std::set<Cells> locks;
+        while (!pending.empty()) {
+            auto tetromino = pending.back();
+            pending.pop_back();
+            std::vector<Tetromino> moved;
+            for (auto [dx, dy] : { std::pair{ -1, 0 }, std::pair{ 1, 0 }, std::pair{ 0, 1 } }) {
+                auto next = tetromino;
+                next.x += dx;
+                next.y += dy;
+                moved.push_back(next);
+            }
+            for (int direction : { 1, -1 }) {
+                auto rotated = tetromino;
+                rotated.rotate(direction);
+                for (auto [dx, dy] : tetromino.wall_kick_tests(direction)) {
+                    rotated.x = tetromino.x + dx;
+                    rotated.y = tetromino.y + dy;
+                    if (bucket.fits(rotated)) {
+                        moved.push_back(rotated);
+                        break;
+                    }
+                }
+            }
+            if (!bucket.fits(moved[2])) {
+                locks.insert(cells_of(tetromino));
+            }
+            for (auto&& next : moved) {
+                if (bucket.fits(next) && seen.insert({ next.x, next.y, next.rotation() }).second) {
+                    pending.push_back(next);
+                }
+            }
+        }
+        return locks;
+    }
+
+    // Stacks of random cells, with overhangs to tuck and spin under, or rows full but for a gap or two.
+    Bucket random_board(tetris::Random& random) {
+        Bucket bucket;
+        bool gapped = random.bounded(2);
+        int height = static_cast<int>(random.bounded(Bucket::ROWS - 2));
+        for (int y = Bucket::ROWS - 1; y >= Bucket::ROWS - height; --y) {
+            Bucket::RowT row = 0;
+            if (gapped) {
+                row = Bucket::FULL_ROW & ~(1u << random.bounded(Bucket::COLS)) & ~(random.bounded(3) ? 0u : 1u << random.bounded(Bucket::COLS));
+            }
+            else {
+                for (int x = 0; x < Bucket::COLS; ++x) {
+                    row |= static_cast<Bucket::RowT>(random.bounded(100) < 60) << x;
+                }
+            }
+            bucket.set_row(y, row);
+        }
+        return bucket;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t boards = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 3000;
+    tetris::Random random{ 42 };
+    tetris::PlacementGenerator generator;
+    size_t checked = 0;
+    size_t failures = 0;
+    for (size_t board = 0; board < boards; ++board) {
+        auto bucket = random_board(random);
+        for (int style = 0; style < 7; ++style) {
+            Tetromino spawned{ static_cast<tetris::BlockStyle>(style) };
+            spawned.x = tetris::SPAWN_X;
+            spawned.y = tetris::SPAWN_Y;
+            if (!bucket.fits(spawned)) {
+                continue;
+            }
+            std::set<Cells> generated;
+            size_t reported = 0;
+            bool fit = true;
+            generator.generate(bucket, spawned, [&](const tetris::Placement& placement) {
+                Tetromino placed{ spawned.style(), placement.rotation };
+                placed.x = placement.x;
+                placed.y = placement.y;
+                fit = fit && bucket.fits(placed);
+                generated.insert(cells_of(placed));
+                ++reported;
+            });
+            auto expected = search(bucket, spawned);
+            if (!fit || generated != expected || reported != generated.size()) {
+                if (failures++ < 10) {
+                    std::fprintf(stderr, "Board %zu, piece %c: %zu placements reported, %zu distinct, %zu expected%s\n", board,
+                        "IJLOSTZ"[style], reported, generated.size(), expected.size(), fit ? "" : ", some don't fit");
+                }
+            }
+            ++checked;
+        }
+    }
+    if (failures) {
+        std::fprintf(stderr, "%zu of %zu generations differ from the naive search\n", failures, checked);
+        return 1;
+    }
+    std::fprintf(stderr, "%zu generations match the naive search\n", checked);
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "movegen.hpp"
+#include "tetris.hpp"
+#include "thread_pool.hpp"
+
+// Counts every sequence of placements of a piece sequence from a board, like perft in chess engines.
+// Node counts are a regression oracle for movement, wall kicks and line clears, and nodes per second
+// measure the move generator.
+//
+// Usage: tetris-perft [--seed N | --pieces IJLOSTZ...] [--board ROWS] [--depth N] [--threads N] [--hash MB] [--expect COUNTS]
+//
+// Pieces are dealt from the 7-bag of the seed unless given. ROWS are the bottom rows of the board from top
+// to bottom, separated by '/', '#' for occupied cells and '.' for empty ones, e.g. "#########./####.#####".
+// --hash caches subtree counts by board hash, so boards reached by different placement orders are counted once.
+// --expect takes the node counts of depths 1 to N separated by commas, e.g. "34,306,5381", and fails the run
+// if a count differs, so the counts check the rules.
+
+namespace {
+
+    using tetris::BlockStyle;
+    using tetris::Bucket;
+
+    // Subtree counts by board, ply and depth, shared by the threads without locks: an entry is stored as
+    // its count and the count XORed with the key, so a torn entry fails validation. Counts are 64-bit,
+    // which the float values of TranspositionTable can't hold exactly.
+    class SubtreeCache final {
+    public:
+        explicit SubtreeCache(size_t bytes) :
+            mask_{ slot_count_for_(bytes) - 1 },
+            slots_{ new Slot[mask_ + 1] },
+            hits_{ 0 }
+        {
+            for (size_t i = 0; i <= mask_; ++i) {
+                slots_[i].check.store(0, std::memory_order_relaxed);
+                slots_[i].data.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        bool probe(uint64_t key, uint64_t& count) noexcept {
+            auto& slot = slots_[key & mask_];
+            auto data = slot.data.load(std::memory_order_relaxed);
+            if (!data || (data ^ slot.check.load(std::memory_order_relaxed)) != key) {
+                return false;
+            }
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            count = data - 1;
+            return true;
+        }
+
+        void store(uint64_t key, uint64_t count) noexcept {
+            auto& slot = slots_[key & mask_];
+            // 0 marks empty slots.
+            auto data = count + 1;
+            slot.data.store(data, std::memory_order_relaxed);
+            slot.check.store(data ^ key, std::memory_order_relaxed);
+        }
+
+        uint64_t hits() const noexcept { return hits_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot final {
+            std::atomic<uint64_t> check;
+            std::atomic<uint64_t> data;
+        };
+
+    private:
+        static size_t slot_count_for_(size_t bytes) noexcept {
+            size_t count = 1;
+            while (count * 2 * sizeof(Slot) <= bytes) {
+                count *= 2;
+            }
+            return count;
+        }
+
+    private:
+        size_t mask_;
+        std::unique_ptr<Slot[]> slots_;
+        std::atomic<uint64_t> hits_;
+    };
+
+    class Perft final {
+    public:
+        Perft(std::vector<BlockStyle> pieces, tetris::ThreadPool& pool, SubtreeCache* cache) :
+            pieces_{ std::move(pieces) },
+            pool_{ pool },
+            cache_{ cache }
+        {}
+
+        // Number of placement sequences of the first depth pieces from the bucket.
+        uint64_t count(const Bucket& bucket, size_t depth) {
+            if (depth == 0) {
+                return 1;
+            }
+            // Subtrees of the first placements are counted in parallel.
+            std::vector<Bucket> children;
+            tetris::PlacementGenerator generator;
+            auto tetromino = spawned_(0);
+            if (!bucket.fits(tetromino)) {
+                return 0;
+            }
+            generator.generate(bucket, tetromino, [&](const tetris::Placement& placement) {
+                children.push_back(locked_(bucket, tetromino, placement));
+            });
+            if (depth == 1) {
+                return children.size();
+            }
+            std::vector<uint64_t> counts(children.size());
+            pool_.parallel_for(children.size(), [&](size_t i) {
+                std::vector<tetris::PlacementGenerator> generators(depth);
+                counts[i] = count_(children[i], 1, depth, generators);
+            });
+            uint64_t total = 0;
+            for (auto count : counts) {
+                total += count;
+            }
+            return total;
+        }
+
+    private:
+        tetris::Tetromino spawned_(size_t ply) const noexcept {
+            tetris::Tetromino tetromino{ pieces_[ply] };
+            tetromino.x = tetris::SPAWN_X;
+            tetromino.y = tetris::SPAWN_Y;
+            return tetromino;
+        }
+
+        static Bucket locked_(Bucket bucket, const tetris::Tetromino& tetromino, const tetris::Placement& placement) noexcept {
+            tetris::Tetromino placed{ tetromino.style(), placement.rotation };
+            placed.x = placement.x;
+            placed.y = placement.y;
+            bucket.place(placed);
+            bucket.remove_full_rows(placed.top(), placed.bottom());
+            return bucket;
+        }
+
+        static uint64_t key_(const Bucket& bucket, size_t ply, size_t depth) noexcept {
+            uint64_t state = static_cast<uint64_t>(ply) << 32 | depth;
+            return bucket.hash() ^ tetris::split_mix64(state);
+        }
+
+        uint64_t count_(const Bucket& bucket, size_t ply, size_t depth, std::vector<tetris::PlacementGenerator>& generators) {
+            auto tetromino = spawned_(ply);
+            if (!bucket.fits(tetromino)) {
+                // Topped out.
+                return 0;
+            }
+            uint64_t count = 0;
+            if (ply + 1 == depth) {
+                // Leaves are counted without locking them.
+                generators[ply].generate(bucket, tetromino, [&](const tetris::Placement&) { ++count; });
+                return count;
+            }
+            uint64_t key = 0;
+            if (cache_) {
+                key = key_(bucket, ply, depth);
+                if (cache_->probe(key, count)) {
+                    return count;
+                }
+            }
+            generators[ply].generate(bucket, tetromino, [&](const tetris::Placement& placement) {
+                count += count_(locked_(bucket, tetromino, placement), ply + 1, depth, generators);
+            });
+            if (cache_) {
+                cache_->store(key, count);
+            }
+            return count;
+        }
+
+    private:
+        std::vector<BlockStyle> pieces_;
+        tetris::ThreadPool& pool_;
+        SubtreeCache* cache_;
+    };
+
+    size_t parse_count(const char* text, bool allow_zero = false) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || *text == '-' || (!value && !allow_zero)) {
+            std::fprintf(stderr, "Expected a %s number, got '%s'\n", allow_zero ? "non-negative" : "positive", text);
+            std::exit(1);
+        }
+        return value;
+    }
+
+    std::vector<BlockStyle> parse_pieces(const char* text) {
+        constexpr char NAMES[] = "IJLOSTZ";
+        std::vector<BlockStyle> pieces;
+        for (; *text; ++text) {
+            const char* name = std::strchr(NAMES, *text);
+            if (!name) {
+                std::fprintf(stderr, "Unknown piece '%c', expected one of %s\n", *text, NAMES);
+                std::exit(1);
+            }
+            pieces.push_back(static_cast<BlockStyle>(name - NAMES));
+        }
+        return pieces;
+    }
+
+    std::vector<uint64_t> parse_counts(const char* list) {
+        std::vector<uint64_t> counts;
+        for (const char* text = list;;) {
+            char* end = nullptr;
+            counts.push_back(std::strtoull(text, &end, 10));
+            if (end == text || *text == '-' || (*end && *end != ',')) {
+                std::fprintf(stderr, "Expected node counts separated by commas, got '%s'\n", list);
+                std::exit(1);
+            }
+            if (!*end) {
+                return counts;
+            }
+            text = end + 1;
+        }
+    }
+
+    Bucket parse_board(const char* text) {
+        std::vector<Bucket::RowT> rows{ 0 };
+        int x = 0;
+        for (; *text; ++text) {
+            if (*text == '/') {
+                rows.push_back(0);
+                x = 0;
+                continue;
+            }
+            if ((*text != '#' && *text != '.') || x == Bucket::COLS) {
+                std::fprintf(stderr, "Board rows are %d of '#' or '.' separated by '/'\n", Bucket::COLS);
+                std::exit(1);
+            }
+            rows.back() |= static_cast<Bucket::RowT>(*text == '#') << x++;
+        }
+        if (rows.size() > Bucket::ROWS) {
+            std::fprintf(stderr, "Board has more than %d rows\n", Bucket::ROWS);
+            std::exit(1);
+        }
+        Bucket bucket;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            bucket.set_row(static_cast<int>(Bucket::ROWS - rows.size() + i), rows[i]);
+        }
+        return bucket;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t seed = 1;
+    std::vector<BlockStyle> pieces;
+    Bucket bucket;
+    size_t depth = 3;
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t hash_megabytes = 0;
+    std::vector<uint64_t> expected;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--seed")) {
+            seed = parse_count(argv[i + 1], true);
+        }
+        else if (!std::strcmp(argv[i], "--pieces")) {
+            pieces = parse_pieces(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--board")) {
+            bucket = parse_board(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--depth")) {
+            depth = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--threads")) {
+            threads = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--hash")) {
+            hash_megabytes = parse_count(argv[i + 1], true);
+        }
+        else if (!std::strcmp(argv[i], "--expect")) {
+            expected = parse_counts(argv[i + 1]);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::fprintf(stderr, "Option '%s' needs a value\n", argv[argc - 1]);
+        return 1;
+    }
+    if (pieces.empty()) {
+        tetris::PreviewQueue bag{ tetris::BagGenerator{ seed }, 1 };
+        while (pieces.size() < depth) {
+            pieces.push_back(bag.pop());
+        }
+    }
+    if (pieces.size() < depth) {
+        std::fprintf(stderr, "%zu pieces given for depth %zu\n", pieces.size(), depth);
+        return 1;
+    }
+    if (!expected.empty() && expected.size() != depth) {
+        std::fprintf(stderr, "%zu node counts expected for depth %zu\n", expected.size(), depth);
+        return 1;
+    }
+
+    std::unique_ptr<SubtreeCache> cache;
+    if (hash_megabytes) {
+        cache = std::make_unique<SubtreeCache>(hash_megabytes << 20);
+    }
+    tetris::ThreadPool pool{ threads };
+    Perft perft{ pieces, pool, cache.get() };
+
+    std::string sequence;
+    for (size_t i = 0; i < depth; ++i) {
+        sequence += "IJLOSTZ"[static_cast<int>(pieces[i])];
+    }
+    std::printf("pieces %s, %zu threads, hash %zu MiB\n", sequence.c_str(), threads, hash_megabytes);
+    std::printf("%6s %16s %10s %14s\n", "depth", "nodes", "seconds", "nodes/s");
+    size_t mismatches = 0;
+    for (size_t d = 1; d <= depth; ++d) {
+        auto start = std::chrono::steady_clock::now();
+        auto nodes = perft.count(bucket, d);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::printf("%6zu %16llu %10.3f %14.0f", d, static_cast<unsigned long long>(nodes), elapsed.count(),
+            nodes / elapsed.count());
+        if (!expected.empty() && nodes != expected[d - 1]) {
+            std::printf("  expected %llu", static_cast<unsigned long long>(expected[d - 1]));
+            ++mismatches;
+        }
+        std::printf("\n");
+    }
+    if (cache) {
+        std::printf("hash hits %llu\n", static_cast<unsigned long long>(cache->hits()));
+    }
+    if (mismatches) {
+        std::fprintf(stderr, "%zu node counts differ from the expected ones\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
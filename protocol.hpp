@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "tetris.hpp"
+
+/**
+* Protocol between tetris-server and its clients over a Unix domain stream socket. Integers are little endian.
+*
+*   hello:  "TTSV" version(u8) seed(u64)
+*
+* A client opens with hello, the server starts a game from the seed. After that every client message is
+* a single byte: an Action other than Tick, or RESET to start the game over from the same seed.
+*
+*   frame:  size(u8) inputs(u32) score(u32) cleared_lines(u16) level(u8) next(u8) row_count(u8) rows
+*   row:    y(u8) mask(u16)
+*
+* The server sends a frame after applying inputs, even if they changed nothing, and whenever gravity changed
+* the game. Changes that pile up while the client doesn't read are coalesced into one frame. size counts the
+* bytes after itself. inputs is the number of client messages applied so far, so a client knows which of its
+* inputs a frame shows. next is the style of the next tetromino, with GAME_OVER set once
+* the game is over. Rows are the bucket with the falling tetromino, only the ones changed since the
+* previous frame, so the first frame has all occupied ones.
+*/
+
+namespace tetris::protocol {
+
+    inline constexpr char MAGIC[4] = { 'T', 'T', 'S', 'V' };
+    inline constexpr uint8_t VERSION = 1;
+    inline constexpr size_t HELLO_SIZE = sizeof(MAGIC) + 1 + 8;
+    inline constexpr uint8_t RESET = 0xff;
+    inline constexpr uint8_t GAME_OVER = 0x80;
+    inline constexpr size_t FRAME_HEADER_SIZE = 1 + 4 + 4 + 2 + 1 + 1 + 1;
+    inline constexpr size_t ROW_SIZE = 3;
+    inline constexpr size_t MAX_FRAME_SIZE = FRAME_HEADER_SIZE + Bucket::ROWS * ROW_SIZE;
+    inline constexpr size_t INVALID_FRAME = SIZE_MAX;
+
+    using RowsT = std::array<Bucket::RowT, Bucket::ROWS>;
+
+    struct Frame final {
+        uint32_t inputs;
+        uint32_t score;
+        uint16_t cleared_lines;
+        uint8_t level;
+        BlockStyle next;
+        bool game_over;
+    };
+
+    inline uint8_t* put(uint8_t* out, uint64_t value, size_t bytes) noexcept {
+        for (size_t i = 0; i < bytes; ++i) {
+            *out++ = static_cast<uint8_t>(value >> (8 * i));
+        }
+        return out;
+    }
+
+    inline uint64_t get(const uint8_t* in, size_t bytes) noexcept {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    // Writes HELLO_SIZE bytes.
+    inline void encode_hello(uint8_t* out, uint64_t seed) noexcept {
+        out = std::copy(std::begin(MAGIC), std::end(MAGIC), out);
+        *out++ = VERSION;
+        put(out, seed, 8);
+    }
+
+    inline bool decode_hello(const uint8_t* in, uint64_t& seed) noexcept {
+        if (!std::equal(std::begin(MAGIC), std::end(MAGIC), in) || in[sizeof(MAGIC)] != VERSION) {
+            return false;
+        }
+        seed = get(in + sizeof(MAGIC) + 1, 8);
+        return true;
+    }
+
+    // Writes the frame of the game to out, which has room for MAX_FRAME_SIZE bytes, and updates rows, the rows
+    // the client has, to the ones sent. Returns the frame size.
+    inline size_t encode_frame(uint8_t* out, const Tetris& game, uint32_t inputs, RowsT& rows) noexcept {
+        auto* begin = out;
+        out = put(out + 1, inputs, 4);
+        out = put(out, static_cast<uint32_t>(std::min<size_t>(game.score(), UINT32_MAX)), 4);
+        out = put(out, static_cast<uint16_t>(std::min<size_t>(game.cleared_lines(), UINT16_MAX)), 2);
+        *out++ = static_cast<uint8_t>(std::min<size_t>(game.level(), UINT8_MAX));
+        *out++ = static_cast<uint8_t>(static_cast<uint8_t>(game.next_tetromino().style()) | (game.game_over() ? GAME_OVER : 0));
+        auto* row_count = out++;
+        *row_count = 0;
+        for (int y = 0; y < Bucket::ROWS; ++y) {
+            auto row = game.bucket().row(y);
+            if (row != rows[y]) {
+                rows[y] = row;
+                *out++ = static_cast<uint8_t>(y);
+                out = put(out, row, 2);
+                ++*row_count;
+            }
+        }
+        *begin = static_cast<uint8_t>(out - begin - 1);
+        return static_cast<size_t>(out - begin);
+    }
+
+    // Decodes the frame at the start of the size bytes at in and applies its rows. Returns the frame size,
+    // 0 if it isn't complete yet, and INVALID_FRAME without applying anything if its size doesn't match its
+    // row count or a row is outside the bucket.
+    inline size_t decode_frame(const uint8_t* in, size_t size, Frame& frame, RowsT& rows) noexcept {
+        if (!size || size < static_cast<size_t>(in[0]) + 1) {
+            return 0;
+        }
+        auto frame_size = static_cast<size_t>(in[0]) + 1;
+        if (frame_size < FRAME_HEADER_SIZE || frame_size != FRAME_HEADER_SIZE + in[13] * ROW_SIZE) {
+            return INVALID_FRAME;
+        }
+        for (uint8_t i = 0; i < in[13]; ++i) {
+            if (in[FRAME_HEADER_SIZE + i * ROW_SIZE] >= Bucket::ROWS) {
+                return INVALID_FRAME;
+            }
+        }
+        frame.inputs = static_cast<uint32_t>(get(in + 1, 4));
+        frame.score = static_cast<uint32_t>(get(in + 5, 4));
+        frame.cleared_lines = static_cast<uint16_t>(get(in + 9, 2));
+        frame.level = in[11];
+        frame.next = static_cast<BlockStyle>(in[12] & ~GAME_OVER);
+        frame.game_over = in[12] & GAME_OVER;
+        const auto* row = in + FRAME_HEADER_SIZE;
+        for (uint8_t i = 0; i < in[13]; ++i, row += ROW_SIZE) {
+            rows[row[0]] = static_cast<Bucket::RowT>(get(row + 1, 2));
+        }
+        return frame_size;
+    }
+}
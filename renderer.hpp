@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+
+#include "tetris.hpp"
+#include "trace.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace tetris {
+
+    // Draws the game into a text frame and writes the cells changed since the last frame to stdout. The frame is
+    // laid out for a bucket Cols wide and Rows high.
+    template <int Cols, int Rows>
+    class BasicTerminalTetrisRenderer final {
+    public:
+        using BucketT = BasicBucket<Cols, Rows>;
+
+    public:
+        BasicTerminalTetrisRenderer() :
+            frame_{},
+            last_frame_{},
+            output_{},
+            output_size_{ 0 },
+            first_frame_{ true }
+        {
+            //     6 8    14  18   23 26 29 32 35 38 41 44 47 50                     73
+            //     | |     |   |    |  |  |  |  |  |  |  |  |  |                      |
+            // LINES CLEARED:    0 <! .  .  .  .  .  .  .  .  .  . !>
+            // LEVEL:            1 <! .  .  .  .  .  .  .  .  .  . !> 7: left  9: right
+            //   SCORE:       0    <! .  .  .  .  .  .  .  .  .  . !>    8: rotate
+            //                     <!==============================!>
+            //                       \/\/\/\/\/\/\/\/\/\/\/\/\/\/\/
+            std::fill(std::begin(frame_), std::end(frame_), ' ');
+            for (int row = 0; row < SCREEN_ROWS; ++row) {
+                frame_[row * LINE_WIDTH + LINE_WIDTH - 1] = '\n';
+            }
+            for (int row = 0; row <= BucketT::ROWS; ++row) {
+                draw_text_(row, BUCKET_X - 2, "<!");
+                draw_text_(row, BUCKET_X + BUCKET_WIDTH, "!>");
+            }
+            for (int column = BUCKET_X; column < BUCKET_X + BUCKET_WIDTH; ++column) {
+                frame_[BucketT::ROWS * LINE_WIDTH + column] = '=';
+            }
+            for (int column = BUCKET_X; column < BUCKET_X + BUCKET_WIDTH; column += 2) {
+                draw_text_(BucketT::ROWS + 1, column, "\\/");
+            }
+            draw_text_(0, 0, "LINES CLEARED:");
+            draw_text_(1, 0, "LEVEL:");
+            draw_text_(2, 2, "SCORE:");
+            draw_text_(NEXT_LABEL_Y, 6, "NEXT:");
+            draw_text_(1, HELP_X + 1, "7: left  9: right");
+            draw_text_(2, HELP_X + 4, "8: rotate");
+            draw_text_(3, HELP_X + 3, "4: speed up");
+            draw_text_(4, HELP_X + 2, "space - reset");
+            draw_text_(5, HELP_X + 2, "q - quit");
+            draw_bucket(BucketT{});
+            draw_cleared_lines(0);
+            draw_level(1);
+            draw_score(0);
+#ifdef _WIN32
+            auto output = GetStdHandle(STD_OUTPUT_HANDLE);
+            DWORD mode = 0;
+            GetConsoleMode(output, &mode);
+            SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
+        }
+
+        void draw_bucket(const BucketT& bucket) noexcept {
+            trace::Span span{ "draw_bucket" };
+            for (int i = 0; i < BucketT::ROWS; ++i) {
+                auto row = bucket.row(i);
+                auto it = std::begin(frame_) + i * LINE_WIDTH + BUCKET_X;
+                for (int j = 0; j < BucketT::COLS; ++j) {
+                    it = std::copy(std::begin(CELL_GLYPHS[(row >> j) & 1]), std::end(CELL_GLYPHS[(row >> j) & 1]), it);
+                }
+            }
+        }
+
+        // Draws an upcoming tetromino in the slot, slot 0 is for the next one.
+        void draw_next_tetromino(const Tetromino& tetromino, int slot = 0) noexcept {
+            trace::Span span{ "draw_next_tetromino" };
+            assert(slot >= 0 && slot < static_cast<int>(PREVIEW_SLOTS) && "Preview slot is out of range");
+            constexpr int X_RANGE_BEGIN = 6;
+            constexpr int X_RANGE_END = 18;
+            int y_range_begin = PREVIEWS_Y + slot * PREVIEW_HEIGHT;
+            for (int i = y_range_begin; i < y_range_begin + PREVIEW_HEIGHT; ++i) {
+                std::fill_n(std::begin(frame_) + i * LINE_WIDTH + X_RANGE_BEGIN, X_RANGE_END - X_RANGE_BEGIN + 1, ' ');
+            }
+            // Tetrominoes spawn occupying rows -1 and 0 around their center.
+            constexpr int CENTER_X = (X_RANGE_BEGIN + X_RANGE_END) / 2;
+            int center_idx = (y_range_begin + 1) * LINE_WIDTH + CENTER_X;
+            for (auto&& mino : tetromino.shape().minos) {
+                int idx = center_idx + CELL_WIDTH * mino.x + LINE_WIDTH * mino.y;
+                std::copy(std::begin(CELL_GLYPHS[1]), std::end(CELL_GLYPHS[1]), std::begin(frame_) + idx);
+            }
+        }
+
+        void draw_score(size_t score) noexcept {
+            trace::Span span{ "draw_score" };
+            constexpr int SCORE_OFFSET = 8;
+            constexpr int SCORE_WIDTH = 8;
+            draw_number_(2, SCORE_OFFSET, SCORE_WIDTH, score);
+        }
+
+        void draw_level(size_t level) noexcept {
+            trace::Span span{ "draw_level" };
+            constexpr int LEVEL_OFFSET = 15;
+            constexpr int LEVEL_WIDTH = 4;
+            draw_number_(1, LEVEL_OFFSET, LEVEL_WIDTH, level);
+        }
+
+        void draw_cleared_lines(size_t cleared_lines) noexcept {
+            trace::Span span{ "draw_cleared_lines" };
+            constexpr int CL_OFFSET = 15;
+            constexpr int CL_WIDTH = 4;
+            draw_number_(0, CL_OFFSET, CL_WIDTH, cleared_lines);
+        }
+
+        // Draws everything shown of the game: the bucket, the statistics and as many previews as it deals.
+        // Game is BasicTetris of the same bucket or anything with the same accessors.
+        template <typename Game>
+        void draw_game(const Game& game) noexcept {
+            for (size_t i = 0; i < game.preview_depth(); ++i) {
+                draw_next_tetromino(game.preview(i), static_cast<int>(i));
+            }
+            draw_bucket(game.bucket());
+            draw_score(game.score());
+            draw_cleared_lines(game.cleared_lines());
+            draw_level(game.level());
+        }
+
+        // Draws a line of text into the overlay under the help, cut or padded to the overlay width.
+        void draw_overlay(int line, std::string_view text) noexcept {
+            assert(line >= 0 && line < OVERLAY_LINES && "Overlay line is out of range");
+            auto it = std::begin(frame_) + (OVERLAY_Y + line) * LINE_WIDTH + HELP_X;
+            auto length = std::min<size_t>(text.size(), RIGHT_PANEL_WIDTH);
+            it = std::copy_n(std::begin(text), length, it);
+            std::fill_n(it, RIGHT_PANEL_WIDTH - length, ' ');
+        }
+
+        // Writes the cells changed since the previously rendered frame with a single write call.
+        // Returns the number of bytes written.
+        size_t render() noexcept {
+            trace::Span span{ "render" };
+            output_size_ = 0;
+            if (first_frame_) {
+                append_("\x1b[2J\x1b[H");
+                append_(std::begin(frame_), std::end(frame_));
+                first_frame_ = false;
+            }
+            else {
+                append_changes_();
+                // Park the cursor below the frame so that anything else printed doesn't overwrite it.
+                append_cursor_move_(SCREEN_ROWS, 0);
+            }
+            write_output_();
+            last_frame_ = frame_;
+            return output_size_;
+        }
+
+    private:
+        // Frame layout: statistics and the next tetromino on the left, the bucket in the middle, help on the right.
+        static constexpr int CELL_WIDTH = 3;
+        static constexpr int LEFT_PANEL_WIDTH = 20;
+        static constexpr int RIGHT_PANEL_WIDTH = 19;
+        static constexpr int BUCKET_X = LEFT_PANEL_WIDTH + 2;
+        static constexpr int BUCKET_WIDTH = BucketT::COLS * CELL_WIDTH;
+        static constexpr int HELP_X = BUCKET_X + BUCKET_WIDTH + 2;
+        static constexpr int LINE_WIDTH = HELP_X + RIGHT_PANEL_WIDTH + 1;
+        static constexpr int SCREEN_ROWS = BucketT::ROWS + 2;
+        static constexpr int FRAME_SIZE = LINE_WIDTH * SCREEN_ROWS;
+        // Upcoming tetrominoes are stacked under the NEXT label, a slot of PREVIEW_HEIGHT rows each.
+        static constexpr int NEXT_LABEL_Y = 4;
+        static constexpr int PREVIEWS_Y = NEXT_LABEL_Y + 1;
+        static constexpr int PREVIEW_HEIGHT = 3;
+        static constexpr int OVERLAY_Y = 7;
+
+        static_assert(BucketT::ROWS >= PREVIEWS_Y + PREVIEW_HEIGHT, "Bucket is too low for the panels");
+
+    public:
+        static constexpr size_t PREVIEW_SLOTS = (BucketT::ROWS - PREVIEWS_Y) / PREVIEW_HEIGHT;
+        // Lines of the overlay, from under the help to the bottom of the screen.
+        static constexpr int OVERLAY_LINES = SCREEN_ROWS - OVERLAY_Y;
+
+    private:
+        // Changed spans are at least a byte long and separated by a gap of at least MIN_SKIPPED_GAP bytes,
+        // so with the cursor moves they take less than twice the frame.
+        static constexpr int OUTPUT_CAPACITY = 2 * FRAME_SIZE + 64;
+
+        static constexpr std::array<std::array<char, CELL_WIDTH>, 2> CELL_GLYPHS = { {
+            { ' ', '.', ' ' },
+            { '[', ' ', ']' }
+        } };
+
+        using FrameT = std::array<char, FRAME_SIZE>;
+
+    private:
+        void draw_text_(int row, int column, std::string_view text) noexcept {
+            std::copy(std::begin(text), std::end(text), std::begin(frame_) + row * LINE_WIDTH + column);
+        }
+
+        // Draws the number right aligned in the field of the width.
+        void draw_number_(int row, int column, int width, size_t number) noexcept {
+            std::array<char, 20> digits;
+            auto digits_end = std::to_chars(digits.data(), digits.data() + digits.size(), number).ptr;
+            int length = static_cast<int>(digits_end - digits.data());
+            assert(length <= width && "Number doesn't fit its field");
+            length = std::min(length, width);
+            auto it = std::begin(frame_) + row * LINE_WIDTH + column;
+            it = std::fill_n(it, width - length, ' ');
+            std::copy(digits_end - length, digits_end, it);
+        }
+
+        void append_changes_() noexcept {
+            // Unchanged gaps shorter than a cursor move are rewritten rather than skipped.
+            constexpr int MIN_SKIPPED_GAP = 8;
+            for (int row = 0; row < SCREEN_ROWS; ++row) {
+                int row_begin = row * LINE_WIDTH;
+                int row_end = row_begin + LINE_WIDTH - 1;
+                int i = row_begin;
+                while (i < row_end) {
+                    if (frame_[i] == last_frame_[i]) {
+                        ++i;
+                        continue;
+                    }
+                    int span_begin = i;
+                    int span_end = i + 1;
+                    for (int gap = 0; i < row_end && gap < MIN_SKIPPED_GAP; ++i) {
+                        if (frame_[i] != last_frame_[i]) {
+                            span_end = i + 1;
+                            gap = 0;
+                        }
+                        else {
+                            ++gap;
+                        }
+                    }
+                    append_cursor_move_(row, span_begin - row_begin);
+                    append_(std::begin(frame_) + span_begin, std::begin(frame_) + span_end);
+                    i = span_end;
+                }
+            }
+        }
+
+        void append_cursor_move_(int row, int column) noexcept {
+            auto begin = output_.data() + output_size_;
+            // Leaves room for the separators after each number.
+            auto end = output_.data() + output_.size() - 1;
+            auto it = std::copy_n("\x1b[", 2, begin);
+            it = std::to_chars(it, end, row + 1).ptr;
+            *it++ = ';';
+            it = std::to_chars(it, end, column + 1).ptr;
+            *it++ = 'H';
+            output_size_ = it - output_.data();
+        }
+
+        template <typename It>
+        void append_(It begin, It end) noexcept {
+            auto it = std::copy(begin, end, output_.data() + output_size_);
+            output_size_ = it - output_.data();
+        }
+
+        void append_(std::string_view text) noexcept {
+            append_(std::begin(text), std::end(text));
+        }
+
+        void write_output_() const noexcept {
+            trace::Span span{ "flush" };
+#ifdef _WIN32
+            DWORD written = 0;
+            WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), output_.data(), static_cast<DWORD>(output_size_), &written, nullptr);
+#else
+            const char* data = output_.data();
+            size_t remaining = output_size_;
+            while (remaining) {
+                auto written = write(STDOUT_FILENO, data, remaining);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                data += written;
+                remaining -= static_cast<size_t>(written);
+            }
+#endif
+        }
+
+    private:
+        FrameT frame_;
+        FrameT last_frame_;
+        std::array<char, OUTPUT_CAPACITY> output_;
+        size_t output_size_;
+        bool first_frame_;
+    };
+
+    using TerminalTetrisRenderer = BasicTerminalTetrisRenderer<Bucket::COLS, Bucket::ROWS>;
+}
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "renderer.hpp"
+#include "tetris.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Checks that drawing and rendering a frame doesn't allocate once the renderer is warmed up. Global operator
+// new is replaced by one that counts, and a game is played and rendered to the null device frame by frame.
+//
+// Usage: tetris-renderer-alloc-test [FRAMES]
+
+namespace {
+
+    size_t allocations = 0;
+
+    void* allocate(std::size_t size) {
+        ++allocations;
+        if (void* p = std::malloc(size ? size : 1)) {
+            return p;
+        }
+        throw std::bad_alloc{};
+    }
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv) {
+    constexpr size_t WARMUP_FRAMES = 100;
+    size_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000;
+
+    std::fflush(stdout);
+#ifdef _WIN32
+    int null = _open("NUL", _O_WRONLY);
+    _dup2(null, 1);
+    _close(null);
+#else
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+#endif
+
+    constexpr uint64_t SEED = 2024;
+    tetris::Tetris game{ SEED, 3 };
+    tetris::TerminalTetrisRenderer renderer;
+    tetris::Random random{ SEED };
+    size_t failed = 0;
+    for (size_t frame = 0; frame < WARMUP_FRAMES + frames; ++frame) {
+        // Actions change the bucket, the previews and the statistics between frames, games start over when lost.
+        game.act(static_cast<tetris::Action>(random.bounded(static_cast<uint32_t>(tetris::Action::Tick) + 1)));
+        if (game.game_over()) {
+            game.reset(SEED + frame);
+        }
+        auto before = allocations;
+        renderer.draw_game(game);
+        renderer.render();
+        if (frame >= WARMUP_FRAMES && allocations != before) {
+            std::fprintf(stderr, "Frame %zu allocated %zu times\n", frame, allocations - before);
+            ++failed;
+        }
+    }
+    if (failed) {
+        std::fprintf(stderr, "%zu of %zu frames allocated\n", failed, frames);
+        return 1;
+    }
+    std::fprintf(stderr, "%zu frames without allocations\n", frames);
+    return 0;
+}
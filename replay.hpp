@@ -0,0 +1,583 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tetris.hpp"
+
+/**
+* Replay file format. Integers are LEB128 varints unless noted.
+*
+*   header: "TTRP" version(byte) preview_depth seed
+*   event:  tag(byte) time_delta payload
+*
+* The low 3 bits of the tag are the event kind, the high 5 bits carry small arguments. time_delta is the
+* wall-clock time since the previous event (since recording started for the first one), in us.
+*
+*   Update      delta in ns
+*   Act         action in the tag
+*   SpeedUp     enabled flag in the tag
+*   Reset       seed
+*   Lock        rotation in the tag, x and y as bytes
+*/
+
+namespace tetris {
+
+    enum class ReplayEventKind : uint8_t {
+        Update, Act, SpeedUp, Reset, Lock
+    };
+
+    struct ReplayEvent final {
+        long long timestamp; // since recording started, in ns
+        ReplayEventKind kind;
+        Action action;
+        bool speed_up;
+        long long delta; // in ns
+        uint64_t seed;
+        int8_t x;
+        int8_t y;
+        int8_t rotation;
+    };
+
+    namespace replay_format {
+        inline constexpr std::array<char, 4> MAGIC = { 'T', 'T', 'R', 'P' };
+        inline constexpr uint8_t VERSION = 1;
+        inline constexpr int KIND_BITS = 3;
+        inline constexpr size_t MAX_VARINT_SIZE = 10;
+        inline constexpr size_t MAX_EVENT_SIZE = 1 + 2 * MAX_VARINT_SIZE;
+
+        inline uint8_t* write_varint(uint8_t* out, uint64_t value) noexcept {
+            while (value >= 0x80) {
+                *out++ = static_cast<uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            *out++ = static_cast<uint8_t>(value);
+            return out;
+        }
+
+        // Returns nullptr if the varint runs past the end.
+        inline const uint8_t* read_varint(const uint8_t* in, const uint8_t* end, uint64_t& value) noexcept {
+            value = 0;
+            for (int shift = 0; in != end && shift < 64; shift += 7) {
+                uint8_t byte = *in++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return in;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    // Appends events to a replay file through a buffer, so recording a tick doesn't cost a system call.
+    class ReplayWriter final {
+    public:
+        ReplayWriter() :
+            file_{ nullptr },
+            buffer_size_{ 0 },
+            last_timestamp_{ 0 },
+            failed_{ false }
+        {}
+
+        ReplayWriter(const ReplayWriter&) = delete;
+        ReplayWriter& operator=(const ReplayWriter&) = delete;
+
+        ~ReplayWriter() { close(); }
+
+        // Starts a replay of a game created with the seed and preview depth. Timestamps of the events are
+        // taken relative to start_time, in ns. Returns false if the file can't be created.
+        bool open(const char* path, uint64_t seed, size_t preview_depth, long long start_time) {
+            close();
+            file_ = std::fopen(path, "wb");
+            if (!file_) {
+                return false;
+            }
+            last_timestamp_ = start_time;
+            failed_ = false;
+            std::memcpy(buffer_.data(), replay_format::MAGIC.data(), replay_format::MAGIC.size());
+            buffer_size_ = replay_format::MAGIC.size();
+            buffer_[buffer_size_++] = replay_format::VERSION;
+            auto* out = replay_format::write_varint(buffer_.data() + buffer_size_, preview_depth);
+            out = replay_format::write_varint(out, seed);
+            buffer_size_ = out - buffer_.data();
+            return true;
+        }
+
+        bool is_open() const noexcept { return file_; }
+
+        // Returns false if some events couldn't be written.
+        bool close() {
+            if (!file_) {
+                return true;
+            }
+            flush_();
+            failed_ |= std::fclose(file_) != 0;
+            file_ = nullptr;
+            return !failed_;
+        }
+
+        void update(long long timestamp, long long delta) {
+            auto* out = begin_(timestamp, ReplayEventKind::Update, 0);
+            end_(replay_format::write_varint(out, static_cast<uint64_t>(delta)));
+        }
+
+        void act(long long timestamp, Action action) {
+            end_(begin_(timestamp, ReplayEventKind::Act, static_cast<uint8_t>(action)));
+        }
+
+        void set_speed_up(long long timestamp, bool speed_up) {
+            end_(begin_(timestamp, ReplayEventKind::SpeedUp, speed_up));
+        }
+
+        void reset(long long timestamp, uint64_t seed) {
+            auto* out = begin_(timestamp, ReplayEventKind::Reset, 0);
+            end_(replay_format::write_varint(out, seed));
+        }
+
+        void lock(long long timestamp, const Tetromino& tetromino) {
+            auto* out = begin_(timestamp, ReplayEventKind::Lock, static_cast<uint8_t>(tetromino.rotation()));
+            *out++ = static_cast<uint8_t>(tetromino.x);
+            *out++ = static_cast<uint8_t>(tetromino.y);
+            end_(out);
+        }
+
+    private:
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    private:
+        uint8_t* begin_(long long timestamp, ReplayEventKind kind, uint8_t argument) {
+            assert(file_ && "Replay isn't open");
+            if (buffer_size_ + replay_format::MAX_EVENT_SIZE > buffer_.size()) {
+                flush_();
+            }
+            // Clocks may be read out of order by a few us, which is recorded as no time passing.
+            auto time_delta = std::max(timestamp - last_timestamp_, 0LL) / 1000;
+            last_timestamp_ += time_delta * 1000;
+            auto* out = buffer_.data() + buffer_size_;
+            *out++ = static_cast<uint8_t>(static_cast<uint8_t>(kind) | argument << replay_format::KIND_BITS);
+            return replay_format::write_varint(out, static_cast<uint64_t>(time_delta));
+        }
+
+        void end_(uint8_t* out) noexcept { buffer_size_ = out - buffer_.data(); }
+
+        void flush_() {
+            failed_ |= std::fwrite(buffer_.data(), 1, buffer_size_, file_) != buffer_size_;
+            buffer_size_ = 0;
+        }
+
+    private:
+        std::FILE* file_;
+        std::array<uint8_t, BUFFER_SIZE> buffer_;
+        size_t buffer_size_;
+        long long last_timestamp_; // in ns, advanced by whole us like the recorded deltas
+        bool failed_;
+    };
+
+    // Forwards calls to a game and records them to a replay if one is open. Calls are stamped with the time
+    // set by set_time().
+    class RecordingTetris final {
+    public:
+        RecordingTetris(Tetris& game, ReplayWriter& writer) noexcept :
+            game_{ game },
+            writer_{ writer },
+            time_{ 0 }
+        {}
+
+        // Steady clock time of the following calls, in ns.
+        void set_time(long long time) noexcept { time_ = time; }
+
+        bool update(long long delta) {
+            if (writer_.is_open()) {
+                writer_.update(time_, delta);
+            }
+            return game_.update(delta);
+        }
+
+        bool act(Action action) {
+            if (writer_.is_open()) {
+                writer_.act(time_, action);
+            }
+            return game_.act(action);
+        }
+
+        void set_speed_up(bool speed_up) {
+            if (writer_.is_open()) {
+                writer_.set_speed_up(time_, speed_up);
+            }
+            game_.set_speed_up(speed_up);
+        }
+
+        void reset(uint64_t seed) {
+            if (writer_.is_open()) {
+                writer_.reset(time_, seed);
+            }
+            game_.reset(seed);
+        }
+
+        bool lock(const Tetromino& tetromino) {
+            if (writer_.is_open()) {
+                writer_.lock(time_, tetromino);
+            }
+            return game_.lock(tetromino);
+        }
+
+        const Tetris& game() const noexcept { return game_; }
+
+    private:
+        Tetris& game_;
+        ReplayWriter& writer_;
+        long long time_; // in ns
+    };
+
+    // Read-only memory map of a whole file. Pages are read in by the OS as they are touched, so large
+    // replays stream instead of being loaded up front.
+    class MappedFile final {
+    public:
+        MappedFile() : data_{ nullptr }, size_{ 0 } {}
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() { close(); }
+
+        // Returns false if the file can't be mapped.
+        bool open(const char* path) {
+            close();
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size) || !size.QuadPart) {
+                CloseHandle(file);
+                return !size.QuadPart;
+            }
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (!mapping) {
+                return false;
+            }
+            data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+            if (!data_) {
+                return false;
+            }
+            size_ = static_cast<size_t>(size.QuadPart);
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat status;
+            if (fstat(fd, &status) || !status.st_size) {
+                bool empty = !status.st_size;
+                ::close(fd);
+                return empty;
+            }
+            void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                return false;
+            }
+            madvise(data, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+            data_ = static_cast<const uint8_t*>(data);
+            size_ = static_cast<size_t>(status.st_size);
+#endif
+            return true;
+        }
+
+        void close() noexcept {
+            if (!data_) {
+                return;
+            }
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        const uint8_t* data() const noexcept { return data_; }
+        size_t size() const noexcept { return size_; }
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+    };
+
+    // Decodes the events of a replay held in memory.
+    class ReplayReader final {
+    public:
+        ReplayReader(const uint8_t* data, size_t size) noexcept :
+            begin_{ data },
+            end_{ data + size },
+            events_{ nullptr },
+            position_{ nullptr },
+            timestamp_{ 0 },
+            seed_{ 0 },
+            preview_depth_{ 0 }
+        {
+            constexpr size_t MAGIC_SIZE = replay_format::MAGIC.size();
+            if (size < MAGIC_SIZE + 1 || std::memcmp(data, replay_format::MAGIC.data(), MAGIC_SIZE)
+                || data[MAGIC_SIZE] != replay_format::VERSION) {
+                return;
+            }
+            uint64_t preview_depth;
+            auto* in = replay_format::read_varint(data + MAGIC_SIZE + 1, end_, preview_depth);
+            if (in) {
+                in = replay_format::read_varint(in, end_, seed_);
+            }
+            if (!in || preview_depth < 1 || preview_depth > PreviewQueue::MAX_DEPTH) {
+                return;
+            }
+            preview_depth_ = static_cast<size_t>(preview_depth);
+            events_ = in;
+            position_ = in;
+        }
+
+        // Whether the header is valid.
+        bool valid() const noexcept { return events_; }
+        uint64_t seed() const noexcept { return seed_; }
+        size_t preview_depth() const noexcept { return preview_depth_; }
+
+        // Decodes the next event. Returns false at the end of the replay or if the event is truncated or corrupt.
+        bool next(ReplayEvent& event) noexcept {
+            if (!position_ || position_ == end_) {
+                return false;
+            }
+            auto* in = position_;
+            uint8_t tag = *in++;
+            uint8_t argument = tag >> replay_format::KIND_BITS;
+            uint64_t time_delta;
+            in = replay_format::read_varint(in, end_, time_delta);
+            if (!in) {
+                return false;
+            }
+            event.kind = static_cast<ReplayEventKind>(tag & ((1 << replay_format::KIND_BITS) - 1));
+            event.timestamp = timestamp_ + static_cast<long long>(time_delta) * 1000;
+            uint64_t value = 0;
+            switch (event.kind) {
+            case ReplayEventKind::Update:
+                in = replay_format::read_varint(in, end_, value);
+                event.delta = static_cast<long long>(value);
+                break;
+            case ReplayEventKind::Act:
+                if (argument > static_cast<uint8_t>(Action::Tick)) {
+                    return false;
+                }
+                event.action = static_cast<Action>(argument);
+                break;
+            case ReplayEventKind::SpeedUp:
+                event.speed_up = argument;
+                break;
+            case ReplayEventKind::Reset:
+                in = replay_format::read_varint(in, end_, event.seed);
+                break;
+            case ReplayEventKind::Lock:
+                if (argument > 3 || end_ - in < 2) {
+                    return false;
+                }
+                event.rotation = static_cast<int8_t>(argument);
+                event.x = static_cast<int8_t>(*in++);
+                event.y = static_cast<int8_t>(*in++);
+                break;
+            default:
+                return false;
+            }
+            if (!in) {
+                return false;
+            }
+            position_ = in;
+            timestamp_ = event.timestamp;
+            return true;
+        }
+
+        bool at_end() const noexcept { return position_ == end_; }
+
+        // Byte offset of the next event and the timestamp it's relative to, to come back to with seek().
+        size_t offset() const noexcept { return position_ - begin_; }
+        long long timestamp() const noexcept { return timestamp_; }
+
+        void seek(size_t offset, long long timestamp) noexcept {
+            assert(begin_ + offset >= events_ && begin_ + offset <= end_ && "Replay offset is out of range");
+            position_ = begin_ + offset;
+            timestamp_ = timestamp;
+        }
+
+        void rewind() noexcept {
+            position_ = events_;
+            timestamp_ = 0;
+        }
+
+    private:
+        const uint8_t* begin_;
+        const uint8_t* end_;
+        const uint8_t* events_;
+        const uint8_t* position_;
+        long long timestamp_; // of the last decoded event, in ns
+        uint64_t seed_;
+        size_t preview_depth_;
+    };
+
+    // Replays a recording on the headless engine. Every keyframe_interval events the state of the game is kept,
+    // so seeking only replays the events since the closest one. Fast forwarding over an archive doesn't need
+    // keyframes, interval 0 turns them off.
+    class ReplayPlayer final {
+    public:
+        ReplayPlayer(const uint8_t* data, size_t size, size_t keyframe_interval = 4096) :
+            reader_{ data, size },
+            game_{ reader_.seed(), std::max<size_t>(reader_.preview_depth(), 1) },
+            keyframe_interval_{ keyframe_interval },
+            events_{ 0 },
+            time_{ 0 },
+            corrupt_{ !reader_.valid() }
+        {}
+
+        // Whether the replay is broken: a bad header, a truncated event or a lock where the tetromino can't be.
+        bool corrupt() const noexcept { return corrupt_; }
+        const Tetris& game() const noexcept { return game_; }
+        // Timestamp of the last applied event, in ns.
+        long long time() const noexcept { return time_; }
+        size_t events() const noexcept { return events_; }
+
+        // Timestamp of the next event, in ns. Returns false at the end of the replay.
+        bool next_time(long long& timestamp) const noexcept {
+            ReplayReader lookahead = reader_;
+            ReplayEvent event;
+            if (corrupt_ || !lookahead.next(event)) {
+                return false;
+            }
+            timestamp = event.timestamp;
+            return true;
+        }
+
+        // Applies the next event to the game. Returns false at the end of the replay or once it's corrupt.
+        bool step() {
+            ReplayEvent event;
+            if (corrupt_ || !reader_.next(event)) {
+                corrupt_ |= !reader_.at_end();
+                return false;
+            }
+            if (!apply_(event)) {
+                corrupt_ = true;
+                return false;
+            }
+            ++events_;
+            time_ = event.timestamp;
+            if (keyframe_interval_ && events_ % keyframe_interval_ == 0
+                && (keyframes_.empty() || keyframes_.back().events < events_)) {
+                keyframes_.push_back(Keyframe{ reader_.offset(), reader_.timestamp(), events_, game_.state() });
+            }
+            return true;
+        }
+
+        // Applies the events up to the timestamp, in ns. Returns false if the replay ended before it.
+        bool fast_forward(long long timestamp) {
+            ReplayReader lookahead = reader_;
+            ReplayEvent event;
+            while (lookahead.next(event)) {
+                if (event.timestamp > timestamp) {
+                    return true;
+                }
+                if (!step()) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        // Moves to the state right after the events up to the timestamp, in either direction.
+        bool seek(long long timestamp) {
+            auto keyframe = std::upper_bound(keyframes_.begin(), keyframes_.end(), timestamp, [](long long t, const Keyframe& k) {
+                return t < k.timestamp;
+            });
+            if (keyframe != keyframes_.begin() && (timestamp < time_ || std::prev(keyframe)->timestamp > time_)) {
+                --keyframe;
+                reader_.seek(keyframe->offset, keyframe->timestamp);
+                game_.restore(keyframe->state);
+                events_ = keyframe->events;
+                time_ = keyframe->timestamp;
+            }
+            else if (timestamp < time_) {
+                reader_.rewind();
+                game_ = Tetris{ reader_.seed(), reader_.preview_depth() };
+                events_ = 0;
+                time_ = 0;
+                corrupt_ = false;
+            }
+            return fast_forward(timestamp);
+        }
+
+    private:
+        struct Keyframe final {
+            size_t offset;
+            long long timestamp; // in ns
+            size_t events;
+            GameState state;
+        };
+
+    private:
+        // Returns false if the event can't happen in the game.
+        bool apply_(const ReplayEvent& event) {
+            switch (event.kind) {
+            case ReplayEventKind::Update: game_.update(event.delta); break;
+            case ReplayEventKind::Act: game_.act(event.action); break;
+            case ReplayEventKind::SpeedUp: game_.set_speed_up(event.speed_up); break;
+            case ReplayEventKind::Reset: game_.reset(event.seed); break;
+            case ReplayEventKind::Lock: {
+                if (game_.game_over()) {
+                    return false;
+                }
+                auto bucket = game_.bucket();
+                auto falling = game_.tetromino();
+                if (falling.is_undef()) {
+                    falling = game_.next_tetromino();
+                }
+                else {
+                    bucket.remove(falling);
+                }
+                Tetromino locked{ falling.style(), event.rotation };
+                locked.x = event.x;
+                locked.y = event.y;
+                if (!bucket.fits(locked)) {
+                    return false;
+                }
+                game_.lock(locked);
+                break;
+            }
+            }
+            return true;
+        }
+
+    private:
+        ReplayReader reader_;
+        Tetris game_;
+        size_t keyframe_interval_;
+        size_t events_;
+        long long time_; // in ns
+        bool corrupt_;
+        std::vector<Keyframe> keyframes_;
+    };
+}
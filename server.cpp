@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+#include "tetris.hpp"
+#include "timer_wheel.hpp"
+
+// Hosts headless games for clients connecting over a Unix domain socket, see protocol.hpp. Sessions are
+// sharded across a fixed pool of workers: each one accepts connections from the shared listening socket,
+// waits for input on its own epoll instance and keeps the gravity deadlines of its games in a timer wheel.
+// Frames are coalesced per session, a session gets at most one write per batch of events.
+//
+// Usage: tetris-server [--socket PATH] [--workers N] [--interval SECONDS]
+
+namespace {
+
+    using tetris::Action;
+    using tetris::TimerWheel;
+    namespace protocol = tetris::protocol;
+
+    long long steady_now() noexcept {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::atomic<bool> stop{ false };
+
+    // Written by their worker only, read by the report.
+    struct alignas(64) WorkerStats final {
+        std::atomic<uint64_t> sessions{ 0 };
+        std::atomic<uint64_t> inputs{ 0 };
+        std::atomic<uint64_t> frames{ 0 };
+        std::atomic<uint64_t> writes{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+
+        static void add(std::atomic<uint64_t>& total, uint64_t n) noexcept {
+            total.store(total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    struct Session final {
+        explicit Session(int fd) :
+            fd{ fd },
+            game{ 0 },
+            rows{},
+            seed{ 0 },
+            inputs{ 0 },
+            last_update{ 0 },
+            hello{},
+            hello_size{ 0 },
+            out{},
+            out_begin{ 0 },
+            out_end{ 0 },
+            changed{ false },
+            queued{ false },
+            blocked{ false }
+        {}
+
+        int fd;
+        tetris::Tetris game;
+        protocol::RowsT rows; // as the client has them
+        uint64_t seed;
+        uint32_t inputs;
+        long long last_update;
+        std::array<uint8_t, protocol::HELLO_SIZE> hello;
+        size_t hello_size;
+        std::array<uint8_t, protocol::MAX_FRAME_SIZE> out; // frame not written completely yet
+        size_t out_begin;
+        size_t out_end;
+        bool changed; // since the last frame
+        bool queued; // to be sent after the batch
+        bool blocked; // waiting for the socket to be writable
+    };
+
+    class Worker final {
+    public:
+        Worker(int listener, WorkerStats& stats) :
+            listener_{ listener },
+            epoll_{ epoll_create1(EPOLL_CLOEXEC) },
+            stats_{ stats },
+            wheel_{ steady_now() }
+        {
+            if (epoll_ < 0) {
+                std::perror("epoll_create1");
+                std::exit(1);
+            }
+            // Exclusive, so a connection wakes one worker instead of all of them.
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+            event.data.u32 = LISTENER;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, listener_, &event) < 0) {
+                std::perror("epoll_ctl");
+                std::exit(1);
+            }
+            thread_ = std::thread{ [this] { run_(); } };
+        }
+
+        ~Worker() {
+            thread_.join();
+            for (auto&& session : sessions_) {
+                if (session) {
+                    close(session->fd);
+                }
+            }
+            close(epoll_);
+        }
+
+        Worker(const Worker&) = delete;
+        Worker& operator=(const Worker&) = delete;
+
+    private:
+        static constexpr uint32_t LISTENER = UINT32_MAX;
+        static constexpr int MAX_EVENTS = 256;
+        static constexpr int ACCEPT_BATCH = 8;
+        static constexpr int IDLE_TIMEOUT_MS = 100;
+        static constexpr size_t READ_SIZE = 4096;
+
+    private:
+        void run_() {
+            std::array<epoll_event, MAX_EVENTS> events;
+            while (!stop.load(std::memory_order_relaxed)) {
+                int timeout = IDLE_TIMEOUT_MS;
+                if (!wheel_.empty()) {
+                    auto wait = (wheel_.next_tick_time() - steady_now() + 999'999) / 1'000'000;
+                    timeout = static_cast<int>(std::clamp<long long>(wait, 0, IDLE_TIMEOUT_MS));
+                }
+                int n = epoll_wait(epoll_, events.data(), MAX_EVENTS, timeout);
+                auto now = steady_now();
+                for (int i = 0; i < n; ++i) {
+                    auto id = events[i].data.u32;
+                    if (id == LISTENER) {
+                        accept_(now);
+                        continue;
+                    }
+                    if (!sessions_[id]) {
+                        continue;
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        receive_(id, now);
+                    }
+                    if ((events[i].events & EPOLLOUT) && sessions_[id]) {
+                        send_(id);
+                    }
+                }
+                wheel_.advance(now, [&](uint32_t id) { fall_(id, now); });
+                for (auto id : queued_) {
+                    auto& session = sessions_[id];
+                    if (session) {
+                        session->queued = false;
+                        if (!session->blocked) {
+                            send_(id);
+                        }
+                    }
+                }
+                queued_.clear();
+                // Only now, so that no event of this batch reaches a new session under an old id.
+                free_.insert(free_.end(), closed_.begin(), closed_.end());
+                closed_.clear();
+            }
+        }
+
+        void accept_(long long now) {
+            for (int i = 0; i < ACCEPT_BATCH; ++i) {
+                int fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        std::perror("accept4");
+                    }
+                    return;
+                }
+                uint32_t id;
+                if (!free_.empty()) {
+                    id = free_.back();
+                    free_.pop_back();
+                }
+                else {
+                    id = static_cast<uint32_t>(sessions_.size());
+                    sessions_.emplace_back();
+                }
+                sessions_[id] = std::make_unique<Session>(fd);
+                sessions_[id]->last_update = now;
+                WorkerStats::add(stats_.sessions, 1);
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.u32 = id;
+                if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) < 0) {
+                    std::perror("epoll_ctl");
+                    close_(id);
+                }
+            }
+        }
+
+        void receive_(uint32_t id, long long now) {
+            auto& session = *sessions_[id];
+            std::array<uint8_t, READ_SIZE> buffer;
+            uint32_t inputs = session.inputs;
+            while (true) {
+                auto n = recv(session.fd, buffer.data(), buffer.size(), 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+                if (n <= 0) {
+                    close_(id);
+                    return;
+                }
+                const uint8_t* input = buffer.data();
+                const uint8_t* end = input + n;
+                if (session.hello_size < protocol::HELLO_SIZE) {
+                    auto size = std::min<size_t>(protocol::HELLO_SIZE - session.hello_size, n);
+                    std::copy(input, input + size, session.hello.begin() + session.hello_size);
+                    session.hello_size += size;
+                    input += size;
+                    if (session.hello_size < protocol::HELLO_SIZE) {
+                        continue;
+                    }
+                    if (!protocol::decode_hello(session.hello.data(), session.seed)) {
+                        close_(id);
+                        return;
+                    }
+                    session.game.reset(session.seed);
+                    session.last_update = now;
+                    mark_changed_(id);
+                }
+                for (; input < end; ++input) {
+                    if (*input != protocol::RESET && *input >= static_cast<uint8_t>(Action::Tick)) {
+                        close_(id);
+                        return;
+                    }
+                    session.game.update(now - session.last_update);
+                    session.last_update = now;
+                    if (*input == protocol::RESET) {
+                        session.game.reset(session.seed);
+                    }
+                    else {
+                        session.game.act(static_cast<Action>(*input));
+                    }
+                    ++session.inputs;
+                }
+            }
+            if (session.inputs != inputs) {
+                // Every input is acknowledged by a frame, even if it didn't change the game.
+                WorkerStats::add(stats_.inputs, session.inputs - inputs);
+                mark_changed_(id);
+            }
+        }
+
+        // Applies gravity at the deadline.
+        void fall_(uint32_t id, long long now) {
+            auto& session = *sessions_[id];
+            if (session.game.update(now - session.last_update)) {
+                mark_changed_(id);
+            }
+            session.last_update = now;
+            schedule_(id, now);
+        }
+
+        void schedule_(uint32_t id, long long now) {
+            auto& game = sessions_[id]->game;
+            if (game.game_over()) {
+                wheel_.cancel(id);
+            }
+            else {
+                wheel_.schedule(id, now + game.time_to_next_update());
+            }
+        }
+
+        void mark_changed_(uint32_t id) {
+            auto& session = *sessions_[id];
+            session.changed = true;
+            if (!session.queued) {
+                session.queued = true;
+                queued_.push_back(id);
+            }
+            // Gravity continues from the changed game.
+            schedule_(id, session.last_update);
+        }
+
+        // Writes what is left of the last frame, then a new frame if the game changed since.
+        void send_(uint32_t id) {
+            auto& session = *sessions_[id];
+            while (true) {
+                if (session.out_begin == session.out_end) {
+                    if (!session.changed) {
+                        break;
+                    }
+                    session.out_begin = 0;
+                    session.out_end = protocol::encode_frame(session.out.data(), session.game, session.inputs, session.rows);
+                    session.changed = false;
+                    WorkerStats::add(stats_.frames, 1);
+                }
+                auto n = ::send(session.fd, session.out.data() + session.out_begin, session.out_end - session.out_begin,
+                    MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    watch_writable_(id, true);
+                    return;
+                }
+                if (n < 0) {
+                    close_(id);
+                    return;
+                }
+                session.out_begin += static_cast<size_t>(n);
+                WorkerStats::add(stats_.writes, 1);
+                WorkerStats::add(stats_.bytes, static_cast<uint64_t>(n));
+            }
+            watch_writable_(id, false);
+        }
+
+        void watch_writable_(uint32_t id, bool writable) {
+            auto& session = *sessions_[id];
+            if (session.blocked == writable) {
+                return;
+            }
+            session.blocked = writable;
+            epoll_event event{};
+            event.events = EPOLLIN | (writable ? EPOLLOUT : 0u);
+            event.data.u32 = id;
+            epoll_ctl(epoll_, EPOLL_CTL_MOD, session.fd, &event);
+        }
+
+        void close_(uint32_t id) {
+            close(sessions_[id]->fd);
+            sessions_[id].reset();
+            wheel_.cancel(id);
+            closed_.push_back(id);
+            WorkerStats::add(stats_.sessions, static_cast<uint64_t>(-1));
+        }
+
+    private:
+        int listener_;
+        int epoll_;
+        WorkerStats& stats_;
+        TimerWheel wheel_;
+        std::vector<std::unique_ptr<Session>> sessions_; // by id
+        std::vector<uint32_t> free_; // ids
+        std::vector<uint32_t> closed_; // ids freed after the batch
+        std::vector<uint32_t> queued_; // ids of sessions to send frames to after the batch
+        std::thread thread_;
+    };
+
+    double cpu_seconds() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    // Lets the process have as many sessions as the hard limit of open files allows.
+    void raise_file_limit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    size_t parse_count(const char* text) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || *text == '-' || !value) {
+            std::fprintf(stderr, "Expected a positive number, got '%s'\n", text);
+            std::exit(1);
+        }
+        return value;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* path = "/tmp/tetris.sock";
+    size_t workers = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t interval = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--socket")) {
+            path = argv[i + 1];
+        }
+        else if (!std::strcmp(argv[i], "--workers")) {
+            workers = parse_count(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--interval")) {
+            interval = parse_count(argv[i + 1]);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::fprintf(stderr, "Option '%s' needs a value\n", argv[argc - 1]);
+        return 1;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "Socket path '%s' is too long\n", path);
+        return 1;
+    }
+    std::strcpy(address.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listener, SOMAXCONN) < 0) {
+        std::perror(path);
+        return 1;
+    }
+    raise_file_limit();
+    std::signal(SIGINT, [](int) { stop = true; });
+    std::signal(SIGTERM, [](int) { stop = true; });
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<WorkerStats> stats(workers);
+    std::vector<std::unique_ptr<Worker>> pool;
+    for (size_t i = 0; i < workers; ++i) {
+        pool.push_back(std::make_unique<Worker>(listener, stats[i]));
+    }
+    std::printf("listening on %s with %zu workers\n", path, workers);
+    std::printf("%8s %10s %10s %10s %10s %7s %14s\n", "sessions", "inputs/s", "frames/s", "writes/s", "KiB/s", "cores",
+        "sessions/core");
+    std::fflush(stdout);
+
+    auto totals = [&] {
+        std::array<uint64_t, 5> sums{};
+        for (auto&& worker : stats) {
+            sums[0] += worker.sessions.load(std::memory_order_relaxed);
+            sums[1] += worker.inputs.load(std::memory_order_relaxed);
+            sums[2] += worker.frames.load(std::memory_order_relaxed);
+            sums[3] += worker.writes.load(std::memory_order_relaxed);
+            sums[4] += worker.bytes.load(std::memory_order_relaxed);
+        }
+        return sums;
+    };
+    auto last = totals();
+    auto last_time = steady_now();
+    auto last_cpu = cpu_seconds();
+    while (!stop) {
+        // Sleeps in short steps to quit soon after a signal.
+        auto deadline = last_time + static_cast<long long>(interval) * 1'000'000'000;
+        while (!stop && steady_now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+        }
+        auto now = steady_now();
+        auto cpu = cpu_seconds();
+        auto current = totals();
+        double seconds = (now - last_time) / 1e9;
+        double cores = (cpu - last_cpu) / seconds;
+        std::printf("%8llu %10.0f %10.0f %10.0f %10.1f %7.2f %14.0f\n", static_cast<unsigned long long>(current[0]),
+            (current[1] - last[1]) / seconds, (current[2] - last[2]) / seconds, (current[3] - last[3]) / seconds,
+            (current[4] - last[4]) / seconds / 1024, cores, cores > 0 ? current[0] / cores : 0.0);
+        std::fflush(stdout);
+        last = current;
+        last_time = now;
+        last_cpu = cpu;
+    }
+
+    pool.clear();
+    close(listener);
+    unlink(path);
+    return 0;
+}
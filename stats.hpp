@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runtime statistics of the game loop: counters and histograms kept per thread, so recording takes no locks
+// and no atomic read-modify-writes, and merged when read. Everything is compiled out unless TETRIS_STATS is
+// defined: record(), count() and ScopedTimer are then empty and summaries are all zeros.
+
+namespace tetris::stats {
+
+    enum class Metric : uint8_t {
+        TickTime, // ns per update step
+        CatchUpTicks, // update steps per game loop iteration
+        DrawTime, // ns to draw a frame
+        RenderTime, // ns to write a frame to the terminal
+        RenderBytes, // bytes written per frame
+        InputLatency // ns from a key press to the write of the frame showing it
+    };
+    inline constexpr size_t METRICS = 6;
+    inline constexpr const char* METRIC_NAMES[METRICS] = {
+        "tick_ns", "catch_up_ticks", "draw_ns", "render_ns", "render_bytes", "input_latency_ns"
+    };
+
+    enum class Counter : uint8_t {
+        Frames,
+        Ticks,
+        KeyPresses,
+        DroppedTicks
+    };
+    inline constexpr size_t COUNTERS = 4;
+    inline constexpr const char* COUNTER_NAMES[COUNTERS] = { "frames", "ticks", "key_presses", "dropped_ticks" };
+
+    struct Summary final {
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        double mean;
+    };
+
+#ifdef TETRIS_STATS
+    inline constexpr bool ENABLED = true;
+
+    // Log-linear buckets like HdrHistogram: values below SUB_BUCKETS are exact, larger ones fall into
+    // SUB_BUCKETS buckets per power of two, so every value is known within 1 / SUB_BUCKETS of itself.
+    class Histogram final {
+    public:
+        static constexpr int SUB_BUCKET_BITS = 4;
+        static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        using CountsT = std::array<uint64_t, BUCKETS>;
+
+    public:
+        static size_t bucket(uint64_t value) noexcept {
+            if (value < SUB_BUCKETS) {
+                return static_cast<size_t>(value);
+            }
+            int magnitude = 63 - __builtin_clzll(value);
+            auto sub_bucket = (value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+            return static_cast<size_t>((magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket);
+        }
+
+        // Smallest value of the bucket.
+        static uint64_t bucket_value(size_t bucket) noexcept {
+            if (bucket < SUB_BUCKETS) {
+                return bucket;
+            }
+            int magnitude = static_cast<int>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+            return (SUB_BUCKETS + bucket % SUB_BUCKETS) << (magnitude - SUB_BUCKET_BITS);
+        }
+
+        static Summary summarize(const CountsT& counts, uint64_t min, uint64_t max, uint64_t sum) noexcept {
+            Summary summary{};
+            for (auto count : counts) {
+                summary.count += count;
+            }
+            if (!summary.count) {
+                return summary;
+            }
+            summary.min = min;
+            summary.max = max;
+            summary.mean = static_cast<double>(sum) / summary.count;
+            auto percentile = [&](uint64_t p) {
+                uint64_t rank = (summary.count * p + 99) / 100;
+                uint64_t seen = 0;
+                for (size_t i = 0; i < counts.size(); ++i) {
+                    seen += counts[i];
+                    if (seen >= rank) {
+                        return std::clamp(bucket_value(i), min, max);
+                    }
+                }
+                return max;
+            };
+            summary.p50 = percentile(50);
+            summary.p90 = percentile(90);
+            summary.p99 = percentile(99);
+            return summary;
+        }
+
+    public:
+        Histogram() noexcept : counts_{}, min_{ UINT64_MAX }, max_{ 0 }, sum_{ 0 } {}
+
+        // Only the owning thread records, so plain loads and stores are enough; they are atomic only
+        // for other threads to read.
+        void record(uint64_t value) noexcept {
+            auto& count = counts_[bucket(value)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            if (value < min_.load(std::memory_order_relaxed)) {
+                min_.store(value, std::memory_order_relaxed);
+            }
+            if (value > max_.load(std::memory_order_relaxed)) {
+                max_.store(value, std::memory_order_relaxed);
+            }
+        }
+
+        void add_to(CountsT& counts, uint64_t& min, uint64_t& max, uint64_t& sum) const noexcept {
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                counts[i] += counts_[i].load(std::memory_order_relaxed);
+            }
+            min = std::min(min, min_.load(std::memory_order_relaxed));
+            max = std::max(max, max_.load(std::memory_order_relaxed));
+            sum += sum_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> counts_;
+        std::atomic<uint64_t> min_;
+        std::atomic<uint64_t> max_;
+        std::atomic<uint64_t> sum_;
+    };
+
+    struct ThreadStats final {
+        std::array<Histogram, METRICS> histograms;
+        std::array<std::atomic<uint64_t>, COUNTERS> counters{};
+    };
+
+    // Statistics of every thread that recorded anything. They outlive their threads, so nothing recorded is lost.
+    class Registry final {
+    public:
+        static Registry& instance() {
+            static Registry registry;
+            return registry;
+        }
+
+        ThreadStats& add() {
+            std::lock_guard lock{ mutex_ };
+            threads_.push_back(std::make_unique<ThreadStats>());
+            return *threads_.back();
+        }
+
+        Summary summary(Metric metric) {
+            auto counts = std::make_unique<Histogram::CountsT>();
+            uint64_t min = UINT64_MAX;
+            uint64_t max = 0;
+            uint64_t sum = 0;
+            std::lock_guard lock{ mutex_ };
+            for (auto&& thread : threads_) {
+                thread->histograms[static_cast<size_t>(metric)].add_to(*counts, min, max, sum);
+            }
+            return Histogram::summarize(*counts, min, max, sum);
+        }
+
+        uint64_t total(Counter counter) {
+            uint64_t total = 0;
+            std::lock_guard lock{ mutex_ };
+            for (auto&& thread : threads_) {
+                total += thread->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+    private:
+        Registry() = default;
+
+    private:
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<ThreadStats>> threads_;
+    };
+
+    inline ThreadStats& local() {
+        thread_local ThreadStats& stats = Registry::instance().add();
+        return stats;
+    }
+
+    inline void record(Metric metric, uint64_t value) noexcept {
+        local().histograms[static_cast<size_t>(metric)].record(value);
+    }
+
+    inline void count(Counter counter, uint64_t n = 1) noexcept {
+        auto& total = local().counters[static_cast<size_t>(counter)];
+        total.store(total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline Summary summary(Metric metric) { return Registry::instance().summary(metric); }
+    inline uint64_t total(Counter counter) { return Registry::instance().total(counter); }
+
+    // Records the time from its construction to its destruction.
+    class ScopedTimer final {
+    public:
+        explicit ScopedTimer(Metric metric) noexcept :
+            metric_{ metric },
+            start_{ std::chrono::steady_clock::now() }
+        {}
+
+        ~ScopedTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            record(metric_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Metric metric_;
+        std::chrono::steady_clock::time_point start_;
+    };
+#else
+    inline constexpr bool ENABLED = false;
+
+    inline void record(Metric, uint64_t) noexcept {}
+    inline void count(Counter, uint64_t = 1) noexcept {}
+    inline Summary summary(Metric) { return Summary{}; }
+    inline uint64_t total(Counter) { return 0; }
+
+    class ScopedTimer final {
+    public:
+        explicit ScopedTimer(Metric) noexcept {}
+    };
+#endif
+
+    // Appends a line per counter and metric, prefixed with the time in seconds.
+    inline void dump(std::FILE* file, double time) {
+        for (size_t i = 0; i < COUNTERS; ++i) {
+            std::fprintf(file, "%.3f %s %llu\n", time, COUNTER_NAMES[i],
+                static_cast<unsigned long long>(total(static_cast<Counter>(i))));
+        }
+        for (size_t i = 0; i < METRICS; ++i) {
+            auto s = summary(static_cast<Metric>(i));
+            std::fprintf(file, "%.3f %s count=%llu min=%llu p50=%llu p90=%llu p99=%llu max=%llu mean=%.1f\n", time,
+                METRIC_NAMES[i], static_cast<unsigned long long>(s.count), static_cast<unsigned long long>(s.min),
+                static_cast<unsigned long long>(s.p50), static_cast<unsigned long long>(s.p90),
+                static_cast<unsigned long long>(s.p99), static_cast<unsigned long long>(s.max), s.mean);
+        }
+        std::fflush(file);
+    }
+}
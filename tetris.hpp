@@ -0,0 +1,1415 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace tetris {
+
+    // Game time advanced by a single Action::Tick, in ns.
+    inline constexpr long long NS_PER_TICK = 16'000'000;
+
+    // Position new tetrominoes appear at on the standard bucket. BasicTetris::SPAWN_X centers them on other widths.
+    inline constexpr int8_t SPAWN_X = 5;
+    inline constexpr int8_t SPAWN_Y = 1;
+
+    enum class Action : uint8_t {
+        Left, Right, RotateRight, RotateLeft, SoftDrop, Tick
+    };
+
+    // PCG32 (XSH-RR) on a fixed stream. Every game owns one, so games are reproducible from their seed
+    // and can run on any number of threads without sharing state.
+    class Random final {
+    public:
+        explicit Random(uint64_t seed) noexcept : state_{ 0 } {
+            next();
+            state_ += seed;
+            next();
+        }
+
+        uint32_t next() noexcept {
+            uint64_t state = state_;
+            state_ = state * MULTIPLIER + INCREMENT;
+            auto xorshifted = static_cast<uint32_t>(((state >> 18) ^ state) >> 27);
+            auto rotation = static_cast<uint32_t>(state >> 59);
+            return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+        }
+
+        // Uniformly distributed number in [0, bound), without the bias of next() % bound.
+        uint32_t bounded(uint32_t bound) noexcept {
+            uint64_t product = static_cast<uint64_t>(next()) * bound;
+            auto low = static_cast<uint32_t>(product);
+            if (low < bound) {
+                uint32_t threshold = (0u - bound) % bound;
+                while (low < threshold) {
+                    product = static_cast<uint64_t>(next()) * bound;
+                    low = static_cast<uint32_t>(product);
+                }
+            }
+            return static_cast<uint32_t>(product >> 32);
+        }
+
+        // Raw state, to continue the sequence from where it was.
+        uint64_t state() const noexcept { return state_; }
+        void set_state(uint64_t state) noexcept { state_ = state; }
+
+    private:
+        static constexpr uint64_t MULTIPLIER = 6364136223846793005ULL;
+        static constexpr uint64_t INCREMENT = 1442695040888963407ULL;
+
+        uint64_t state_;
+    };
+
+    // SplitMix64, to derive constant tables of random keys at compile time.
+    constexpr uint64_t split_mix64(uint64_t& state) noexcept {
+        uint64_t z = state += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Zobrist keys of the cells of a bucket, looked up by chunks of ChunkCols columns: keys[y][chunk][mask] is
+    // the XOR of the keys of the cells of the mask in that chunk of row y. A whole row mask hashes with one lookup
+    // per chunk.
+    template <int Rows, int Chunks, int ChunkCols>
+    constexpr auto make_zobrist_row_keys(uint64_t seed) noexcept {
+        std::array<std::array<std::array<uint64_t, 1 << ChunkCols>, Chunks>, Rows> keys{};
+        for (int y = 0; y < Rows; ++y) {
+            for (int chunk = 0; chunk < Chunks; ++chunk) {
+                std::array<uint64_t, ChunkCols> cell_keys{};
+                for (auto&& key : cell_keys) {
+                    key = split_mix64(seed);
+                }
+                for (int mask = 1; mask < (1 << ChunkCols); ++mask) {
+                    int lowest = __builtin_ctz(mask);
+                    keys[y][chunk][mask] = keys[y][chunk][mask & (mask - 1)] ^ cell_keys[lowest];
+                }
+            }
+        }
+        return keys;
+    }
+
+    struct Mino final {
+        int8_t x;
+        int8_t y;
+    };
+
+    using MinosT = std::array<Mino, 4>;
+    using RowMasksT = std::array<uint16_t, 4>;
+    using WallKickData = std::array<Mino, 5>;
+
+    // Minos of a block style in one of its rotations with their bounding box, bitmasks of the rows they occupy
+    // and the lowest mino of every column.
+    struct Shape final {
+        MinosT minos;
+        RowMasksT row_masks; // bit i is set for column left + i
+        std::array<int8_t, 4> column_bottoms; // row of the lowest mino in column left + i, relative to top
+        int8_t left;
+        int8_t top;
+        int8_t width;
+        int8_t height;
+    };
+
+    constexpr Shape make_shape(const MinosT& minos) noexcept {
+        Shape shape{ minos, {}, {}, minos[0].x, minos[0].y, 0, 0 };
+        int8_t right = minos[0].x;
+        int8_t bottom = minos[0].y;
+        for (auto&& mino : minos) {
+            shape.left = std::min(shape.left, mino.x);
+            shape.top = std::min(shape.top, mino.y);
+            right = std::max(right, mino.x);
+            bottom = std::max(bottom, mino.y);
+        }
+        shape.width = right - shape.left + 1;
+        shape.height = bottom - shape.top + 1;
+        for (auto&& mino : minos) {
+            shape.row_masks[mino.y - shape.top] |= 1 << (mino.x - shape.left);
+            auto& bottom = shape.column_bottoms[mino.x - shape.left];
+            bottom = std::max(bottom, static_cast<int8_t>(mino.y - shape.top));
+        }
+        return shape;
+    }
+
+    // I block rotates around the center of its 4x4 box rather than around a mino.
+    constexpr MinosT rotate_I_minos(MinosT minos, int rotation) noexcept {
+        /**
+        *  0            1            2            3
+        *  .  .  .  .   .  . [ ] .   .  .  .  .   . [ ] .  .
+        * [ ][ ][ ][ ]  .  . [ ] .   .  .  .  .   . [ ] .  .
+        *  .  .  .  .   .  . [ ] .  [ ][ ][ ][ ]  . [ ] .  .
+        *  .  .  .  .   .  . [ ] .   .  .  .  .   . [ ] .  .
+        *  y = 0        x = 0        y = 1        x = -1
+        *  0/2=0        1/2=0        2/2=1        3/2=1
+        *  0%2=0        1%2=1        2%2=0        3%2=1
+        *  (1-0*2)*0=0  (1-1*2)*0=0  (1-0*2)*1=1  (1-1*2)*1=-1
+        */
+        int rotation_div = rotation / 2;
+        int rotation_rem = rotation % 2;
+        int8_t position_offset = (1 - rotation_rem * 2) * rotation_div;
+        for (auto&& mino : minos) {
+            if (rotation_rem) {
+                mino.y = -mino.x;
+                mino.x = position_offset;
+            }
+            else {
+                mino.x = -mino.y;
+                mino.y = position_offset;
+            }
+        }
+        return minos;
+    }
+
+    // SHAPES[style][rotation] with styles ordered as in Tetromino::BlockStyle, Undef last.
+    inline constexpr std::array<std::array<Shape, 4>, 8> SHAPES = [] {
+        constexpr std::array<MinosT, 8> SPAWN_MINOS = { {
+            {{ { -2, 0 }, { -1, 0 }, { 0, 0 }, { 1, 0 } }},     // I
+            {{ { -1, -1 }, { -1, 0 }, { 0, 0 }, { 1, 0 } }},    // J
+            {{ { -1, 0 }, { 0, 0 }, { 1, 0 }, { 1, -1 } }},     // L
+            {{ { -1, -1 }, { 0, -1 }, { -1, 0 }, { 0, 0 } }},   // O
+            {{ { -1, 0 }, { 0, 0 }, { 0, -1 }, { 1, -1 } }},    // S
+            {{ { -1, 0 }, { 0, 0 }, { 1, 0 }, { 0, -1 } }},     // T
+            {{ { -1, -1 }, { 0, -1 }, { 0, 0 }, { 1, 0 } }},    // Z
+            {{}}                                                // Undef
+        } };
+        constexpr size_t I = 0;
+        constexpr size_t O = 3;
+        constexpr size_t UNDEF = 7;
+        std::array<std::array<Shape, 4>, 8> shapes{};
+        for (size_t style = 0; style < SPAWN_MINOS.size(); ++style) {
+            auto minos = SPAWN_MINOS[style];
+            for (int rotation = 0; rotation < 4; ++rotation) {
+                shapes[style][rotation] = make_shape(minos);
+                if (style == I) {
+                    minos = rotate_I_minos(minos, rotation + 1);
+                }
+                else if (style != O && style != UNDEF) {
+                    for (auto&& mino : minos) {
+                        auto tmp = mino.x;
+                        mino.x = -1 * mino.y;
+                        mino.y = tmp;
+                    }
+                }
+            }
+        }
+        return shapes;
+    }();
+
+    // SRS wall kick tests indexed by the rotation a tetromino is rotated from.
+    struct WallKickTests final {
+        std::array<WallKickData, 4> right;
+        std::array<WallKickData, 4> left;
+    };
+
+    // Kicking back from rotation r + 1 to r tests the same offsets as from r to r + 1, negated.
+    constexpr WallKickTests make_wall_kick_tests(const std::array<WallKickData, 4>& right) noexcept {
+        WallKickTests tests{ right, {} };
+        for (int rotation = 0; rotation < 4; ++rotation) {
+            const auto& reverse = right[(rotation + 3) % 4];
+            for (size_t i = 0; i < reverse.size(); ++i) {
+                tests.left[rotation][i] = Mino{ static_cast<int8_t>(-reverse[i].x), static_cast<int8_t>(-reverse[i].y) };
+            }
+        }
+        return tests;
+    }
+
+    inline constexpr WallKickTests COMMON_WALL_KICK_TESTS = make_wall_kick_tests({ {
+        {{ {0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2} }},
+        {{ {0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2} }},
+        {{ {0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2} }},
+        {{ {0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2} }}
+    } });
+
+    inline constexpr WallKickTests I_WALL_KICK_TESTS = make_wall_kick_tests({ {
+        {{ {0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2} }},
+        {{ {0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1} }},
+        {{ {0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2} }},
+        {{ {0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1} }}
+    } });
+
+    class Tetromino final {
+    public:
+        enum class BlockStyle : uint8_t {
+            I, J, L, O, S, T, Z, Undef
+        };
+
+    public:
+        int8_t x;
+        int8_t y;
+
+    public:
+        static Tetromino I() { return Tetromino{ BlockStyle::I }; }
+        static Tetromino J() { return Tetromino{ BlockStyle::J }; }
+        static Tetromino L() { return Tetromino{ BlockStyle::L }; }
+        static Tetromino O() { return Tetromino{ BlockStyle::O }; }
+        static Tetromino S() { return Tetromino{ BlockStyle::S }; }
+        static Tetromino T() { return Tetromino{ BlockStyle::T }; }
+        static Tetromino Z() { return Tetromino{ BlockStyle::Z }; }
+        static Tetromino Undef() { return Tetromino{ BlockStyle::Undef }; }
+
+        explicit Tetromino(BlockStyle block_style, int8_t rotation = 0) noexcept :
+            x{ 0 },
+            y{ 0 },
+            style_{ block_style },
+            rotation_{ rotation }
+        {
+            assert(rotation_ >= 0 && rotation_ < 4 && "Rotation is out of range");
+        }
+
+        // Rotates clockwise if direction is 1 and counterclockwise if it is -1.
+        void rotate(int direction = 1) noexcept {
+            assert(style_ != BlockStyle::Undef && "Rotation of undefined block is impossible");
+            assert((direction == -1 || direction == 1) && "rotate called with direction other than 1 or -1");
+            rotation_ = (rotation_ + 4 + direction) % 4;
+        }
+
+        std::array<Mino, 4> minos() const noexcept {
+            std::array<Mino, 4> global_minos = shape().minos;
+            for (auto&& mino : global_minos) {
+                mino.x += x;
+                mino.y += y;
+            }
+            return global_minos;
+        }
+
+        const Shape& shape() const noexcept { return SHAPES[static_cast<unsigned>(style_)][rotation_]; }
+
+        // Bounding box of the minos on the bucket.
+        int left() const noexcept { return x + shape().left; }
+        int right() const noexcept { return x + shape().left + shape().width - 1; }
+        int top() const noexcept { return y + shape().top; }
+        int bottom() const noexcept { return y + shape().top + shape().height - 1; }
+
+        // Wall kick tests for rotating in the direction from the current rotation.
+        const WallKickData& wall_kick_tests(int direction) const noexcept {
+            const auto& tests = style_ == BlockStyle::I ? I_WALL_KICK_TESTS : COMMON_WALL_KICK_TESTS;
+            return direction > 0 ? tests.right[rotation_] : tests.left[rotation_];
+        }
+
+        BlockStyle style() const noexcept { return style_; }
+        int8_t rotation() const noexcept { return rotation_; }
+        bool is_undef() const noexcept { return style_ == BlockStyle::Undef; }
+
+    private:
+        BlockStyle style_;
+        int8_t rotation_;
+    };
+
+    // Narrowest row bitmask with a bit for every column of a bucket Cols wide.
+    template <int Cols>
+    using BucketRowT = std::conditional_t<Cols <= 16, uint16_t, std::conditional_t<Cols <= 32, uint32_t, uint64_t>>;
+
+    // Bucket stored as a bitmask per row, bit x is set if the cell in column x is occupied.
+    template <int Cols, int Rows>
+    class BasicBucket final {
+        static_assert(Cols >= 4 && Cols <= 64, "Bucket has to be 4 to 64 columns wide");
+        static_assert(Rows >= 4 && Rows <= 123, "Bucket has to be 4 to 123 rows high, tetromino coordinates are int8_t");
+
+    public:
+        using RowT = BucketRowT<Cols>;
+
+        static constexpr int ROWS = Rows;
+        static constexpr int COLS = Cols;
+        static constexpr RowT FULL_ROW = static_cast<RowT>(~uint64_t{ 0 } >> (64 - COLS));
+
+        // Cell access adapter for a single row, so that bucket[y][x] reads like a 2D array.
+        class RowView final {
+        public:
+            explicit RowView(RowT row) noexcept : row_{ row } {}
+            bool operator[](int x) const noexcept { return (row_ >> x) & 1; }
+
+        private:
+            RowT row_;
+        };
+
+    public:
+        BasicBucket() noexcept : rows_{}, hash_{ 0 } {}
+
+        RowView operator[](int y) const noexcept { return RowView{ rows_[y] }; }
+        RowT row(int y) const noexcept { return rows_[y]; }
+        // The ROWS rows from the top, contiguous.
+        const RowT* data() const noexcept { return rows_.data(); }
+
+        void set_row(int y, RowT row) noexcept {
+            assert(!(row & ~FULL_ROW) && "Row has cells outside the bucket");
+            hash_ ^= row_key(y, rows_[y]) ^ row_key(y, row);
+            rows_[y] = row;
+        }
+
+        // Zobrist hash of the occupied cells, kept up to date by every change.
+        uint64_t hash() const noexcept { return hash_; }
+
+        // Zobrist key of the cells of the mask in row y. Keys of disjoint masks XOR into the key of their union.
+        static uint64_t row_key(int y, RowT mask) noexcept {
+            uint64_t key = 0;
+            for (int chunk = 0; chunk < ZOBRIST_CHUNKS; ++chunk) {
+                key ^= ZOBRIST_ROW_KEYS[y][chunk][(mask >> chunk * ZOBRIST_CHUNK_COLS) & ((1 << ZOBRIST_CHUNK_COLS) - 1)];
+            }
+            return key;
+        }
+
+        // Whether the tetromino lies inside the bucket without overlapping occupied cells.
+        bool fits(const Tetromino& tetromino) const noexcept {
+            int left = tetromino.left();
+            int top = tetromino.top();
+            if (left < 0 || tetromino.right() >= COLS || top < 0 || tetromino.bottom() >= ROWS) {
+                return false;
+            }
+            const auto& shape = tetromino.shape();
+            RowT overlap = 0;
+            for (int i = 0; i < shape.height; ++i) {
+                overlap |= rows_[top + i] & (RowT{ shape.row_masks[i] } << left);
+            }
+            return !overlap;
+        }
+
+        void place(const Tetromino& tetromino) noexcept {
+            const auto& shape = tetromino.shape();
+            int left = tetromino.left();
+            int top = tetromino.top();
+            for (int i = 0; i < shape.height; ++i) {
+                RowT cells = RowT{ shape.row_masks[i] } << left;
+                rows_[top + i] |= cells;
+                hash_ ^= row_key(top + i, cells);
+            }
+        }
+
+        void remove(const Tetromino& tetromino) noexcept {
+            const auto& shape = tetromino.shape();
+            int left = tetromino.left();
+            int top = tetromino.top();
+            for (int i = 0; i < shape.height; ++i) {
+                RowT cells = RowT{ shape.row_masks[i] } << left;
+                rows_[top + i] &= ~cells;
+                hash_ ^= row_key(top + i, cells);
+            }
+        }
+
+        // Full rows among [top, bottom], bit i is set if row top + i is full.
+        int full_rows(int top, int bottom) const noexcept {
+            int rows = 0;
+            for (int y = top; y <= bottom; ++y) {
+                rows |= (rows_[y] == FULL_ROW) << (y - top);
+            }
+            return rows;
+        }
+
+        // Removes the full rows among [top, bottom] and shifts the rows above them down in a single pass.
+        // Returns the number of removed rows.
+        int remove_full_rows(int top, int bottom) noexcept {
+            int full_rows = 0;
+            for (int y = top; y <= bottom; ++y) {
+                full_rows += rows_[y] == FULL_ROW;
+            }
+            if (!full_rows) {
+                return 0;
+            }
+            // Every row either leaves the hash or moves in it from its old to its new position.
+            int to = bottom;
+            for (int from = bottom; from >= 0; --from) {
+                auto row = rows_[from];
+                if (from >= top && row == FULL_ROW) {
+                    hash_ ^= row_key(from, row);
+                }
+                else {
+                    if (to != from) {
+                        hash_ ^= row_key(from, row) ^ row_key(to, row);
+                    }
+                    rows_[to--] = row;
+                }
+            }
+            for (; to >= 0; --to) {
+                rows_[to] = 0;
+            }
+            return full_rows;
+        }
+
+        // Undoes remove_full_rows() of the full rows given like full_rows() returns them: puts them back and
+        // shifts the rows above them up again.
+        void insert_full_rows(int top, int rows) noexcept {
+            assert(rows && "No rows to insert");
+            int bottom = top + 31 - __builtin_clz(static_cast<unsigned>(rows));
+            // Rows move up, so every row is read before the one taking its place is written.
+            int from = __builtin_popcount(static_cast<unsigned>(rows));
+            for (int y = 0; y <= bottom; ++y) {
+                bool full = y >= top && ((rows >> (y - top)) & 1);
+                set_row(y, full ? FULL_ROW : rows_[from++]);
+            }
+        }
+
+        void clear() noexcept {
+            rows_ = {};
+            hash_ = 0;
+        }
+
+    private:
+        // Chunks of at most 5 columns keep the key tables small for wide buckets.
+        static constexpr int ZOBRIST_CHUNKS = (COLS + 4) / 5;
+        static constexpr int ZOBRIST_CHUNK_COLS = (COLS + ZOBRIST_CHUNKS - 1) / ZOBRIST_CHUNKS;
+        static constexpr auto ZOBRIST_ROW_KEYS = make_zobrist_row_keys<ROWS, ZOBRIST_CHUNKS, ZOBRIST_CHUNK_COLS>(0x5eed);
+
+    private:
+        std::array<RowT, ROWS> rows_;
+        uint64_t hash_;
+    };
+
+    // Standard bucket, 10 columns by 20 rows.
+    using Bucket = BasicBucket<10, 20>;
+
+    // Features of a stack of locked tetrominoes that evaluators and drops read: the height of every column, the
+    // cells of every row, the holes, i.e. empty cells under the top of their column, and the highest column.
+    // They're kept up to date as tetrominoes lock and rows clear instead of being scanned from the bucket.
+    template <int Cols, int Rows>
+    class BasicBoardFeatures final {
+    public:
+        using BucketT = BasicBucket<Cols, Rows>;
+
+    public:
+        BasicBoardFeatures() noexcept :
+            heights_{},
+            row_fills_{},
+            holes_{ 0 },
+            max_height_{ 0 },
+            aggregate_height_{ 0 }
+        {}
+
+        // Scans the stack, for a bucket the features weren't kept along with.
+        explicit BasicBoardFeatures(const BucketT& stack) noexcept : BasicBoardFeatures{} {
+            typename BucketT::RowT covered = 0; // columns with an occupied cell above the row
+            for (int y = 0; y < Rows; ++y) {
+                auto row = stack.row(y);
+                row_fills_[y] = static_cast<uint8_t>(__builtin_popcountll(row));
+                holes_ += __builtin_popcountll(covered & ~row);
+                for (auto tops = row & ~covered; tops; tops &= tops - 1) {
+                    heights_[__builtin_ctzll(tops)] = static_cast<uint8_t>(Rows - y);
+                    aggregate_height_ += Rows - y;
+                }
+                if (!covered && row) {
+                    max_height_ = Rows - y;
+                }
+                covered |= row;
+            }
+        }
+
+        // Rows from the bottom to the highest occupied cell of column x, 0 if it's empty.
+        int height(int x) const noexcept { return heights_[x]; }
+        const std::array<uint8_t, Cols>& heights() const noexcept { return heights_; }
+        // Occupied cells of row y.
+        int row_fill(int y) const noexcept { return row_fills_[y]; }
+        int holes() const noexcept { return holes_; }
+        int max_height() const noexcept { return max_height_; }
+        int aggregate_height() const noexcept { return aggregate_height_; }
+
+        // Full rows among [top, bottom] like BasicBucket::full_rows() returns them, from the row counts.
+        int full_rows(int top, int bottom) const noexcept {
+            int rows = 0;
+            for (int y = top; y <= bottom; ++y) {
+                rows |= (row_fills_[y] == Cols) << (y - top);
+            }
+            return rows;
+        }
+
+        // Row the tetromino comes to rest at when it drops straight down, in O(width) from the column heights.
+        // Returns -1 if it's below the top of a column it covers, e.g. tucked under an overhang; the rows under it
+        // have to be searched then.
+        int drop_y(const Tetromino& tetromino) const noexcept {
+            const auto& shape = tetromino.shape();
+            int left = tetromino.left();
+            int drop = Rows;
+            for (int i = 0; i < shape.width; ++i) {
+                // Rows between the lowest mino of the column and the top of the column.
+                int gap = Rows - heights_[left + i] - 1 - tetromino.top() - shape.column_bottoms[i];
+                if (gap < 0) {
+                    return -1;
+                }
+                drop = std::min(drop, gap);
+            }
+            return tetromino.y + drop;
+        }
+
+        // Counts the tetromino that was placed on the stack, before its full rows are removed.
+        void place(const Tetromino& tetromino) noexcept {
+            for (auto&& mino : tetromino.minos()) {
+                ++row_fills_[mino.y];
+                int height = Rows - mino.y;
+                auto& column = heights_[mino.x];
+                if (height <= column) {
+                    // Filled a hole.
+                    --holes_;
+                }
+                else {
+                    // The empty cells between the old and the new top are covered now.
+                    holes_ += height - column - 1;
+                    aggregate_height_ += height - column;
+                    column = static_cast<uint8_t>(height);
+                    max_height_ = std::max(max_height_, height);
+                }
+            }
+        }
+
+        // Counts the removal of the full rows given like full_rows() returns them. stack is the bucket after
+        // BasicBucket::remove_full_rows() removed them.
+        void remove_full_rows(const BucketT& stack, int top, int rows) noexcept {
+            assert(rows && "No rows to remove");
+            int count = __builtin_popcount(static_cast<unsigned>(rows));
+            int bottom = top + 31 - __builtin_clz(static_cast<unsigned>(rows));
+            int to = bottom;
+            for (int from = bottom; from >= 0; --from) {
+                if (from < top || !((rows >> (from - top)) & 1)) {
+                    row_fills_[to--] = row_fills_[from];
+                }
+            }
+            for (; to >= 0; --to) {
+                row_fills_[to] = 0;
+            }
+            // Full rows cross every column, so every column is at least as high as the highest removed row.
+            // Columns higher than that keep their holes and only get lower. Columns whose top was in it drop
+            // to their highest remaining cell, and the empty cells under it that aren't covered anymore stop
+            // being holes. A column has as many holes as its height minus its cells.
+            int removed_top = top + __builtin_ctz(static_cast<unsigned>(rows));
+            typename BucketT::RowT uncovered = 0;
+            for (int x = 0; x < Cols; ++x) {
+                if (Rows - heights_[x] == removed_top) {
+                    uncovered |= typename BucketT::RowT{ 1 } << x;
+                    holes_ -= heights_[x] - count;
+                    aggregate_height_ -= heights_[x];
+                    heights_[x] = 0;
+                }
+                else {
+                    heights_[x] = static_cast<uint8_t>(heights_[x] - count);
+                    aggregate_height_ -= count;
+                }
+            }
+            // Rows from above the removed ones end up above removed_top + count, they're empty in these columns.
+            for (int y = removed_top + count; uncovered && y < Rows; ++y) {
+                auto tops = stack.row(y) & uncovered;
+                uncovered &= ~tops;
+                for (; tops; tops &= tops - 1) {
+                    int x = __builtin_ctzll(tops);
+                    heights_[x] = static_cast<uint8_t>(Rows - y);
+                    holes_ += Rows - y;
+                    aggregate_height_ += Rows - y;
+                }
+            }
+            max_height_ = *std::max_element(heights_.begin(), heights_.end());
+        }
+
+    private:
+        std::array<uint8_t, Cols> heights_;
+        std::array<uint8_t, Rows> row_fills_;
+        int holes_;
+        int max_height_;
+        int aggregate_height_;
+    };
+
+    using BoardFeatures = BasicBoardFeatures<Bucket::COLS, Bucket::ROWS>;
+
+    using BlockStyle = Tetromino::BlockStyle;
+
+    // Block styles are generated in batches, so the random generator is called once per PIECE_BATCH spawns.
+    inline constexpr size_t PIECE_BATCH = 7;
+    using PieceBatchT = std::array<BlockStyle, PIECE_BATCH>;
+
+    // Deals all seven block styles in random order, then starts a new bag. Droughts are at most 12 pieces long.
+    class BagGenerator final {
+    public:
+        explicit BagGenerator(uint64_t seed) noexcept : random_{ seed } {}
+
+        void generate(PieceBatchT& batch) noexcept {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i] = static_cast<BlockStyle>(i);
+            }
+            for (size_t i = batch.size() - 1; i > 0; --i) {
+                std::swap(batch[i], batch[random_.bounded(static_cast<uint32_t>(i + 1))]);
+            }
+        }
+
+        void reset(uint64_t seed) noexcept { random_ = Random{ seed }; }
+
+        uint64_t state() const noexcept { return random_.state(); }
+        void set_state(uint64_t state) noexcept { random_.set_state(state); }
+
+    private:
+        Random random_;
+    };
+
+    // Every block style is chosen independently and uniformly.
+    class UniformGenerator final {
+    public:
+        explicit UniformGenerator(uint64_t seed) noexcept : random_{ seed } {}
+
+        void generate(PieceBatchT& batch) noexcept {
+            constexpr uint32_t STYLES = 7;
+            for (auto&& style : batch) {
+                style = static_cast<BlockStyle>(random_.bounded(STYLES));
+            }
+        }
+
+        void reset(uint64_t seed) noexcept { random_ = Random{ seed }; }
+
+        uint64_t state() const noexcept { return random_.state(); }
+        void set_state(uint64_t state) noexcept { random_.set_state(state); }
+
+    private:
+        Random random_;
+    };
+
+    // Replays a recorded sequence of block styles over and over.
+    class SequenceGenerator final {
+    public:
+        explicit SequenceGenerator(std::vector<BlockStyle> sequence) :
+            sequence_{ std::move(sequence) },
+            position_{ 0 }
+        {
+            assert(!sequence_.empty() && "Sequence of block styles can't be empty");
+        }
+
+        void generate(PieceBatchT& batch) noexcept {
+            for (auto&& style : batch) {
+                style = sequence_[position_];
+                position_ = (position_ + 1) % sequence_.size();
+            }
+        }
+
+        // The sequence is the same for every seed.
+        void reset(uint64_t) noexcept { position_ = 0; }
+
+        uint64_t state() const noexcept { return position_; }
+        void set_state(uint64_t state) noexcept { position_ = static_cast<size_t>(state % sequence_.size()); }
+
+    private:
+        std::vector<BlockStyle> sequence_;
+        size_t position_;
+    };
+
+    using PieceGenerator = std::variant<BagGenerator, UniformGenerator, SequenceGenerator>;
+
+    // Ring buffer of upcoming block styles, refilled from a generator a whole batch at a time. Every style is
+    // stored twice, CAPACITY apart, so the queued ones are contiguous from the head whatever its position.
+    class PreviewQueue final {
+    public:
+        static constexpr size_t CAPACITY = 16;
+        static constexpr size_t MAX_DEPTH = CAPACITY - PIECE_BATCH;
+        static constexpr int PACKED_SIZE_BITS = 4;
+        static_assert(CAPACITY - 1 < (1 << PACKED_SIZE_BITS) && PACKED_SIZE_BITS + 3 * (CAPACITY - 1) <= 64,
+            "Queued styles don't fit 64 bits");
+
+        // Position of the queue to rewind to. Rewinding to marks in the reverse order they were taken only has
+        // to put back the styles popped between a mark and the next one, refills may have overwritten them.
+        // Marks are taken before locks, and a lock and the spawn after it pop at most two styles.
+        struct Mark final {
+            static constexpr size_t KEPT = 2;
+
+            uint64_t generator_state;
+            uint8_t head;
+            uint8_t size;
+            std::array<BlockStyle, KEPT> front;
+        };
+
+    public:
+        PreviewQueue(PieceGenerator generator, size_t depth) :
+            generator_{ std::move(generator) },
+            styles_{},
+            head_{ 0 },
+            size_{ 0 },
+            depth_{ depth }
+        {
+            assert(depth_ >= 1 && depth_ <= MAX_DEPTH && "Preview depth is out of range");
+            refill_();
+        }
+
+        // Upcoming block style, 0 is the next one. Only the first depth() ones are guaranteed to be available.
+        BlockStyle operator[](size_t i) const noexcept {
+            assert(i < size_ && "Preview is out of range");
+            return styles_[head_ + i];
+        }
+
+        // The queued styles, contiguous from the next one. At least depth() of them.
+        const BlockStyle* data() const noexcept { return styles_.data() + head_; }
+
+        BlockStyle pop() noexcept {
+            auto style = styles_[head_];
+            head_ = (head_ + 1) % CAPACITY;
+            --size_;
+            refill_();
+            return style;
+        }
+
+        void reset(uint64_t seed) noexcept {
+            std::visit([seed](auto& generator) { generator.reset(seed); }, generator_);
+            head_ = 0;
+            size_ = 0;
+            refill_();
+        }
+
+        size_t depth() const noexcept { return depth_; }
+
+        uint64_t generator_state() const noexcept {
+            return std::visit([](const auto& generator) { return generator.state(); }, generator_);
+        }
+
+        // Queued styles packed into 64 bits: their number in the low 4 bits, then 3 bits per style.
+        uint64_t packed() const noexcept {
+            uint64_t packed = size_;
+            for (size_t i = 0; i < size_; ++i) {
+                packed |= static_cast<uint64_t>((*this)[i]) << (PACKED_SIZE_BITS + 3 * i);
+            }
+            return packed;
+        }
+
+        // Continues from the generator state and the packed styles of another queue of the same kind of generator.
+        // The depth may differ, the sequence of styles doesn't depend on it.
+        void restore(uint64_t generator_state, uint64_t packed) noexcept {
+            std::visit([generator_state](auto& generator) { generator.set_state(generator_state); }, generator_);
+            head_ = 0;
+            size_ = std::min<size_t>(packed & ((1 << PACKED_SIZE_BITS) - 1), CAPACITY - 1);
+            for (size_t i = 0; i < size_; ++i) {
+                set_(i, static_cast<BlockStyle>((packed >> (PACKED_SIZE_BITS + 3 * i)) & 7));
+            }
+            refill_();
+        }
+
+        Mark mark() const noexcept {
+            Mark mark{ generator_state(), static_cast<uint8_t>(head_), static_cast<uint8_t>(size_), {} };
+            for (size_t i = 0; i < Mark::KEPT; ++i) {
+                mark.front[i] = styles_[head_ + i];
+            }
+            return mark;
+        }
+
+        void rewind(const Mark& mark) noexcept {
+            std::visit([&mark](auto& generator) { generator.set_state(mark.generator_state); }, generator_);
+            head_ = mark.head;
+            size_ = mark.size;
+            for (size_t i = 0; i < Mark::KEPT; ++i) {
+                set_(head_ + i, mark.front[i]);
+            }
+        }
+
+    private:
+        void refill_() noexcept {
+            while (size_ < depth_) {
+                PieceBatchT batch;
+                std::visit([&batch](auto& generator) { generator.generate(batch); }, generator_);
+                for (auto style : batch) {
+                    set_(head_ + size_++, style);
+                }
+            }
+        }
+
+        void set_(size_t i, BlockStyle style) noexcept {
+            i %= CAPACITY;
+            styles_[i] = style;
+            styles_[i + CAPACITY] = style;
+        }
+
+    private:
+        PieceGenerator generator_;
+        std::array<BlockStyle, 2 * CAPACITY> styles_;
+        size_t head_;
+        size_t size_;
+        size_t depth_;
+    };
+
+    // Everything of a game that changes while it's played, in a single cache line for the standard bucket. It's
+    // trivially copyable, so cloning it is a copy, and it restores into any game with the same kind of piece
+    // generator and bucket. Counters are kept to 32 bits, the level to 16, and games stop counting there and
+    // clamp their GameRules to the speeds it holds, so a state always restores the game it was taken from.
+    template <int Cols, int Rows>
+    struct BasicGameState final {
+        using BucketT = BasicBucket<Cols, Rows>;
+        using RowT = typename BucketT::RowT;
+
+        static constexpr size_t CELL_BYTES = (BucketT::ROWS * BucketT::COLS + 7) / 8;
+        static constexpr size_t SERIALIZED_SIZE = 8 + 8 + 4 * 4 + 2 + CELL_BYTES + 3;
+        static constexpr uint8_t GAME_OVER = 0x20;
+        static constexpr uint8_t SPEED_UP = 0x40;
+        static constexpr size_t MAX_COUNT = UINT32_MAX; // of the score and cleared lines
+        static constexpr size_t MAX_LEVEL = UINT16_MAX;
+        static constexpr long long SLOWEST_GAME_SPEED = UINT32_MAX; // in ns per row
+
+        uint64_t generator; // state of the piece generator
+        uint64_t previews; // as PreviewQueue::packed() returns them
+        uint32_t score;
+        uint32_t cleared_lines;
+        uint32_t last_update; // in ns
+        uint32_t common_game_speed; // in ns
+        uint16_t level;
+        std::array<uint8_t, CELL_BYTES> cells; // bucket with the falling tetromino, COLS bits per row from the top
+        uint8_t tetromino; // style in the low 3 bits, rotation in the next 2, then GAME_OVER and SPEED_UP
+        int8_t x;
+        int8_t y;
+
+        RowT row(int y) const noexcept {
+            int first = y * BucketT::COLS;
+            RowT row = 0;
+            for (int bit = first / 8 * 8; bit < first + BucketT::COLS; bit += 8) {
+                RowT byte = cells[bit / 8];
+                row |= bit < first ? byte >> (first - bit) : byte << (bit - first);
+            }
+            return row & BucketT::FULL_ROW;
+        }
+
+        void set_row(int y, RowT row) noexcept {
+            for (int x = 0, bit = y * BucketT::COLS; x < BucketT::COLS; ++x, ++bit) {
+                auto& byte = cells[bit / 8];
+                byte = static_cast<uint8_t>((byte & ~(1 << bit % 8)) | ((row >> x) & 1) << bit % 8);
+            }
+        }
+
+        // Writes SERIALIZED_SIZE bytes, little endian whatever the platform.
+        void serialize(uint8_t* out) const noexcept {
+            auto put = [&out](uint64_t value, int bytes) {
+                for (int i = 0; i < bytes; ++i) {
+                    *out++ = static_cast<uint8_t>(value >> (8 * i));
+                }
+            };
+            put(generator, 8);
+            put(previews, 8);
+            put(score, 4);
+            put(cleared_lines, 4);
+            put(last_update, 4);
+            put(common_game_speed, 4);
+            put(level, 2);
+            out = std::copy(cells.begin(), cells.end(), out);
+            put(tetromino, 1);
+            put(static_cast<uint8_t>(x), 1);
+            put(static_cast<uint8_t>(y), 1);
+        }
+
+        // Reads what serialize() wrote. Returns false if the size is wrong or the bytes aren't a state a game
+        // can be in, e.g. a falling tetromino outside the bucket.
+        bool deserialize(const uint8_t* in, size_t size) noexcept {
+            if (size != SERIALIZED_SIZE) {
+                return false;
+            }
+            auto get = [&in](int bytes) {
+                uint64_t value = 0;
+                for (int i = 0; i < bytes; ++i) {
+                    value |= static_cast<uint64_t>(*in++) << (8 * i);
+                }
+                return value;
+            };
+            BasicGameState state{};
+            state.generator = get(8);
+            state.previews = get(8);
+            state.score = static_cast<uint32_t>(get(4));
+            state.cleared_lines = static_cast<uint32_t>(get(4));
+            state.last_update = static_cast<uint32_t>(get(4));
+            state.common_game_speed = static_cast<uint32_t>(get(4));
+            state.level = static_cast<uint16_t>(get(2));
+            std::copy(in, in + CELL_BYTES, state.cells.begin());
+            in += CELL_BYTES;
+            state.tetromino = static_cast<uint8_t>(get(1));
+            state.x = static_cast<int8_t>(get(1));
+            state.y = static_cast<int8_t>(get(1));
+            if (!state.valid_()) {
+                return false;
+            }
+            *this = state;
+            return true;
+        }
+
+    private:
+        bool valid_() const noexcept {
+            constexpr auto STYLES = static_cast<uint64_t>(BlockStyle::Undef);
+            constexpr int SIZE_BITS = PreviewQueue::PACKED_SIZE_BITS;
+            auto queued = previews & ((1 << SIZE_BITS) - 1);
+            if (!queued || queued >= PreviewQueue::CAPACITY || previews >> (SIZE_BITS + 3 * queued)) {
+                return false;
+            }
+            for (uint64_t i = 0; i < queued; ++i) {
+                if (((previews >> (SIZE_BITS + 3 * i)) & 7) >= STYLES) {
+                    return false;
+                }
+            }
+            if (CELL_BYTES * 8 > BucketT::ROWS * BucketT::COLS && cells.back() >> (BucketT::ROWS * BucketT::COLS % 8)) {
+                return false;
+            }
+            Tetromino falling{ static_cast<BlockStyle>(tetromino & 7), static_cast<int8_t>((tetromino >> 3) & 3) };
+            if (falling.is_undef()) {
+                return true;
+            }
+            falling.x = x;
+            falling.y = y;
+            if (falling.left() < 0 || falling.right() >= BucketT::COLS || falling.top() < 0 || falling.bottom() >= BucketT::ROWS) {
+                return false;
+            }
+            // The bucket has the falling tetromino in it, unless it didn't fit on spawn and ended the game.
+            if (tetromino & GAME_OVER) {
+                return true;
+            }
+            const auto& shape = falling.shape();
+            for (int i = 0; i < shape.height; ++i) {
+                RowT cells = RowT{ shape.row_masks[i] } << falling.left();
+                if ((row(falling.top() + i) & cells) != cells) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    using GameState = BasicGameState<Bucket::COLS, Bucket::ROWS>;
+
+    static_assert(std::is_trivially_copyable_v<GameState> && sizeof(GameState) <= 64, "GameState has to be a cache line of plain data");
+
+    // Gravity curve and scoring table of a game. The defaults are the standard rules: gravity speeds up by a
+    // fifth on every lock up to level 10 and jumps to the maximum at level 29, and line clears score as in BPS.
+    struct GameRules final {
+        long long initial_game_speed = 1'000'000'000; // in ns per row
+        long long max_game_speed = 20'000'000; // in ns per row, from level 29 on
+        uint32_t speed_decay_per_mille = 800; // of the previous speed, on every lock up to level 10
+        std::array<uint32_t, 5> line_scores = { 0, 40, 100, 300, 1200 }; // by the number of rows cleared at once
+
+        // Gravity after a lock that left the game at level, in ns per row.
+        long long next_game_speed(long long game_speed, size_t level) const noexcept {
+            if (level <= 10) {
+                return game_speed * speed_decay_per_mille / 1000;
+            }
+            return level >= 29 ? max_game_speed : game_speed;
+        }
+
+        // The rules with speeds a GameState holds: within [0, GameState::SLOWEST_GAME_SPEED], and never slowing
+        // down on a lock.
+        GameRules clamped() const noexcept {
+            auto rules = *this;
+            rules.initial_game_speed = std::clamp(initial_game_speed, 0LL, GameState::SLOWEST_GAME_SPEED);
+            rules.max_game_speed = std::clamp(max_game_speed, 0LL, GameState::SLOWEST_GAME_SPEED);
+            rules.speed_decay_per_mille = std::min(speed_decay_per_mille, 1000u);
+            return rules;
+        }
+    };
+
+    template <int Cols, int Rows>
+    class BasicTetris;
+
+    // Locks done with Tetris::lock(tetromino, undo), the latest last, for Tetris::undo() to take back. An entry
+    // holds what the lock changed rather than a copy of the game, so one stack serves any bucket size.
+    class UndoStack final {
+    public:
+        size_t size() const noexcept { return entries_.size(); }
+        bool empty() const noexcept { return entries_.empty(); }
+        void clear() noexcept { entries_.clear(); }
+        void reserve(size_t size) { entries_.reserve(size); }
+
+    private:
+        template <int Cols, int Rows>
+        friend class BasicTetris;
+
+        struct Entry final {
+            PreviewQueue::Mark previews;
+            Tetromino falling; // before the lock, Undef if none was falling yet
+            Tetromino locked; // Undef if the game was over before the lock
+            size_t score;
+            size_t level;
+            size_t cleared_lines;
+            long long last_update; // in ns
+            long long common_game_speed; // in ns
+            int cleared_rows; // as BasicBucket::full_rows() returns them for the rows of locked
+            bool game_over;
+        };
+
+    private:
+        std::vector<Entry> entries_;
+    };
+
+    // Rules of the game without any input or output, driven by actions and elapsed time, on a bucket Cols wide
+    // and Rows high.
+    template <int Cols, int Rows>
+    class BasicTetris final {
+    public:
+        using BucketT = BasicBucket<Cols, Rows>;
+        using BoardFeaturesT = BasicBoardFeatures<Cols, Rows>;
+        using GameStateT = BasicGameState<Cols, Rows>;
+
+        static constexpr int8_t SPAWN_X = Cols / 2;
+
+    public:
+        explicit BasicTetris(uint64_t seed, size_t preview_depth = 1, const GameRules& rules = GameRules{}) :
+            BasicTetris{ BagGenerator{ seed }, preview_depth, rules }
+        {}
+
+        BasicTetris(PieceGenerator generator, size_t preview_depth, const GameRules& rules = GameRules{}) :
+            rules_{ rules.clamped() },
+            previews_{ std::move(generator), preview_depth },
+            bucket_{},
+            features_{},
+            tetromino_{ Tetromino::Undef() },
+            score_{ 0 },
+            level_{ 1 },
+            cleared_lines_{ 0 },
+            last_update_{ 0 },
+            game_speed_{ rules_.initial_game_speed },
+            common_game_speed_{ rules_.initial_game_speed },
+            game_over_{ false },
+            speed_up_{ false }
+        {}
+
+        // Advances the game by delta ns: spawns the next tetromino, applies gravity and locks it on the stack.
+        // Returns whether the bucket changed.
+        bool update(long long delta) {
+            if (game_over_) {
+                return false;
+            }
+            bool changed = try_spawn_();
+            if (game_over_) {
+                return false;
+            }
+            last_update_ += delta;
+            if (last_update_ >= game_speed_) {
+                last_update_ = 0;
+                changed |= fall_();
+            }
+            return changed;
+        }
+
+        // Applies a single player action. Returns whether the bucket changed.
+        bool act(Action action) {
+            if (action == Action::Tick) {
+                return update(NS_PER_TICK);
+            }
+            if (game_over_) {
+                return false;
+            }
+            bool changed = try_spawn_();
+            if (game_over_) {
+                return false;
+            }
+            switch (action) {
+            case Action::Left: changed |= try_move_(-1); break;
+            case Action::Right: changed |= try_move_(1); break;
+            case Action::RotateRight: changed |= try_rotate_(1); break;
+            case Action::RotateLeft: changed |= try_rotate_(-1); break;
+            case Action::SoftDrop:
+                // Restarts gravity so that the tetromino doesn't fall twice in a row.
+                last_update_ = 0;
+                changed |= fall_();
+                break;
+            case Action::Tick: break;
+            }
+            return changed;
+        }
+
+        // Moves the falling tetromino to a position it can reach, e.g. one found by PlacementGenerator,
+        // and locks it there. Returns whether the bucket changed.
+        bool lock(const Tetromino& tetromino) {
+            int cleared_rows = 0;
+            return lock_at_(tetromino, cleared_rows);
+        }
+
+        // Like lock(), and pushes what it changed onto the stack for undo(), whether it locked or not.
+        bool lock(const Tetromino& tetromino, UndoStack& undo) {
+            undo.entries_.push_back(UndoStack::Entry{ previews_.mark(), tetromino_, Tetromino::Undef(), score_, level_,
+                cleared_lines_, last_update_, common_game_speed_, 0, game_over_ });
+            auto& entry = undo.entries_.back();
+            if (!lock_at_(tetromino, entry.cleared_rows)) {
+                return false;
+            }
+            entry.locked = tetromino;
+            return true;
+        }
+
+        // Takes back the latest lock on the stack and the moves and spawns since, the game is as it was right
+        // before the lock. Tetrominoes locked since by gravity can't be taken back.
+        void undo(UndoStack& undo) noexcept {
+            assert(!undo.empty() && "Nothing to undo");
+            const auto& entry = undo.entries_.back();
+            // A tetromino that didn't fit on spawn isn't in the bucket.
+            if (!tetromino_.is_undef() && !game_over_) {
+                bucket_.remove(tetromino_);
+            }
+            if (!entry.locked.is_undef()) {
+                if (entry.cleared_rows) {
+                    bucket_.insert_full_rows(entry.locked.top(), entry.cleared_rows);
+                }
+                bucket_.remove(entry.locked);
+                features_ = BoardFeaturesT{ bucket_ };
+            }
+            if (!entry.falling.is_undef() && !entry.game_over) {
+                bucket_.place(entry.falling);
+            }
+            previews_.rewind(entry.previews);
+            tetromino_ = entry.falling;
+            score_ = entry.score;
+            level_ = entry.level;
+            cleared_lines_ = entry.cleared_lines;
+            last_update_ = entry.last_update;
+            common_game_speed_ = entry.common_game_speed;
+            game_over_ = entry.game_over;
+            update_game_speed_();
+            undo.entries_.pop_back();
+        }
+
+        GameStateT state() const noexcept {
+            GameStateT state{};
+            state.generator = previews_.generator_state();
+            state.previews = previews_.packed();
+            state.score = static_cast<uint32_t>(score_);
+            state.cleared_lines = static_cast<uint32_t>(cleared_lines_);
+            state.last_update = static_cast<uint32_t>(last_update_);
+            state.common_game_speed = static_cast<uint32_t>(common_game_speed_);
+            state.level = static_cast<uint16_t>(level_);
+            for (int y = 0; y < BucketT::ROWS; ++y) {
+                state.set_row(y, bucket_.row(y));
+            }
+            state.tetromino = static_cast<uint8_t>(static_cast<unsigned>(tetromino_.style()) | tetromino_.rotation() << 3
+                | (game_over_ ? GameStateT::GAME_OVER : 0) | (speed_up_ ? GameStateT::SPEED_UP : 0));
+            state.x = tetromino_.x;
+            state.y = tetromino_.y;
+            return state;
+        }
+
+        // Continues from the state of a game with the same kind of piece generator. The preview depth may differ.
+        void restore(const GameStateT& state) noexcept {
+            previews_.restore(state.generator, state.previews);
+            for (int y = 0; y < BucketT::ROWS; ++y) {
+                bucket_.set_row(y, state.row(y));
+            }
+            tetromino_ = Tetromino{ static_cast<BlockStyle>(state.tetromino & 7), static_cast<int8_t>((state.tetromino >> 3) & 3) };
+            tetromino_.x = state.x;
+            tetromino_.y = state.y;
+            score_ = state.score;
+            level_ = state.level;
+            cleared_lines_ = state.cleared_lines;
+            last_update_ = state.last_update;
+            common_game_speed_ = state.common_game_speed;
+            game_over_ = state.tetromino & GameStateT::GAME_OVER;
+            speed_up_ = state.tetromino & GameStateT::SPEED_UP;
+            update_game_speed_();
+            auto stack = bucket_;
+            if (!tetromino_.is_undef() && !game_over_) {
+                stack.remove(tetromino_);
+            }
+            features_ = BoardFeaturesT{ stack };
+        }
+
+        // Makes the tetromino fall faster while enabled.
+        void set_speed_up(bool speed_up) noexcept {
+            speed_up_ = speed_up;
+            update_game_speed_();
+        }
+
+        // Starts a new game with the random sequence of the seed.
+        void reset(uint64_t seed) {
+            previews_.reset(seed);
+            bucket_.clear();
+            features_ = BoardFeaturesT{};
+            tetromino_ = Tetromino::Undef();
+            score_ = 0;
+            level_ = 1;
+            cleared_lines_ = 0;
+            last_update_ = 0;
+            common_game_speed_ = rules_.initial_game_speed;
+            game_over_ = false;
+            update_game_speed_();
+        }
+
+        // Time until update() has to be called to make the falling tetromino progress, in ns.
+        long long time_to_next_update() const noexcept {
+            if (tetromino_.is_undef()) {
+                return 0;
+            }
+            return std::max(game_speed_ - last_update_, 0LL);
+        }
+
+        // The bucket includes the falling tetromino.
+        const BucketT& bucket() const& { return bucket_; }
+        // Features of the stack, without the falling tetromino.
+        const BoardFeaturesT& features() const& { return features_; }
+        const Tetromino& tetromino() const& { return tetromino_; }
+
+        // The falling tetromino moved straight down as far as it goes, where a hard drop would lock it and a ghost
+        // piece shows it. Undef if none is falling.
+        Tetromino dropped() const noexcept {
+            if (tetromino_.is_undef() || game_over_) {
+                return Tetromino::Undef();
+            }
+            auto dropped = tetromino_;
+            dropped.y = static_cast<int8_t>(features_.drop_y(tetromino_));
+            if (dropped.y >= 0) {
+                return dropped;
+            }
+            auto stack = bucket_;
+            stack.remove(tetromino_);
+            dropped = tetromino_;
+            auto lower = dropped;
+            ++lower.y;
+            while (stack.fits(lower)) {
+                dropped = lower;
+                ++lower.y;
+            }
+            return dropped;
+        }
+        Tetromino next_tetromino() const noexcept { return preview(0); }
+        // Upcoming tetromino, 0 is the next one, up to preview_depth().
+        Tetromino preview(size_t i) const noexcept { return Tetromino{ previews_[i] }; }
+        size_t preview_depth() const noexcept { return previews_.depth(); }
+        // Styles of the upcoming tetrominoes, contiguous from the next one, at least preview_depth() of them.
+        const BlockStyle* previews() const noexcept { return previews_.data(); }
+        bool game_over() const noexcept { return game_over_; }
+
+        // Hash of the bucket and the falling tetromino, for transposition tables.
+        uint64_t hash() const noexcept {
+            if (tetromino_.is_undef()) {
+                return bucket_.hash();
+            }
+            uint64_t piece = static_cast<uint64_t>(tetromino_.style()) << 24
+                | static_cast<uint64_t>(tetromino_.rotation()) << 16
+                | static_cast<uint64_t>(static_cast<uint8_t>(tetromino_.x)) << 8
+                | static_cast<uint8_t>(tetromino_.y);
+            return bucket_.hash() ^ split_mix64(piece);
+        }
+
+        size_t score() const noexcept { return score_; }
+        size_t cleared_lines() const noexcept { return cleared_lines_; }
+        size_t level() const noexcept { return level_; }
+        const GameRules& rules() const noexcept { return rules_; }
+
+    private:
+        static constexpr long long SPEED_UP_GAME_SPEED = 100'000'000; // in ns
+
+    private:
+        void update_game_speed_() noexcept {
+            game_speed_ = speed_up_ ? std::min(SPEED_UP_GAME_SPEED, common_game_speed_) : common_game_speed_;
+        }
+
+        // Puts the next tetromino on top of the bucket if none is falling, ends the game if it doesn't fit.
+        bool try_spawn_() {
+            if (!tetromino_.is_undef()) {
+                return false;
+            }
+            tetromino_ = next_tetromino();
+            tetromino_.x = SPAWN_X;
+            tetromino_.y = SPAWN_Y;
+            if (!bucket_.fits(tetromino_)) {
+                game_over_ = true;
+                return false;
+            }
+            previews_.pop();
+            bucket_.place(tetromino_);
+            return true;
+        }
+
+        // Moves the tetromino a row down or locks it if it lies on the stack.
+        bool fall_() {
+            bucket_.remove(tetromino_);
+            auto fallen_tetromino = tetromino_;
+            fallen_tetromino.y += 1;
+            if (bucket_.fits(fallen_tetromino)) {
+                tetromino_ = fallen_tetromino;
+                bucket_.place(tetromino_);
+                return true;
+            }
+            lock_();
+            return true;
+        }
+
+        bool lock_at_(const Tetromino& tetromino, int& cleared_rows) {
+            if (game_over_) {
+                return false;
+            }
+            try_spawn_();
+            if (game_over_) {
+                return false;
+            }
+            assert(tetromino.style() == tetromino_.style() && "Locked tetromino is not the falling one");
+            bucket_.remove(tetromino_);
+            assert(bucket_.fits(tetromino) && "Locked tetromino doesn't fit the bucket");
+            tetromino_ = tetromino;
+            last_update_ = 0;
+            cleared_rows = lock_();
+            return true;
+        }
+
+        // Returns the removed rows as BucketT::full_rows() does.
+        int lock_() {
+            bucket_.place(tetromino_);
+            features_.place(tetromino_);
+            int cleared_rows = try_remove_full_rows_();
+            tetromino_ = Tetromino::Undef();
+            update_game_speed_();
+            return cleared_rows;
+        }
+
+        // SRS rotation
+        bool try_rotate_(int direction) {
+            assert((direction == -1 || direction == 1) && "try_rotate_ called with direction other than 1 or -1");
+            bucket_.remove(tetromino_);
+            auto rotated_tetromino = tetromino_;
+            rotated_tetromino.rotate(direction);
+            bool rotated = false;
+            for (auto [x, y] : tetromino_.wall_kick_tests(direction)) {
+                rotated_tetromino.x = tetromino_.x + x;
+                rotated_tetromino.y = tetromino_.y + y;
+                if (bucket_.fits(rotated_tetromino)) {
+                    tetromino_ = rotated_tetromino;
+                    rotated = true;
+                    break;
+                }
+            }
+            bucket_.place(tetromino_);
+            return rotated;
+        }
+
+        bool try_move_(int direction) {
+            assert((direction == -1 || direction == 1) && "try_move_ called with direction other than 1 or -1");
+            bucket_.remove(tetromino_);
+            auto moved_tetromino = tetromino_;
+            moved_tetromino.x += direction;
+            bool moved = bucket_.fits(moved_tetromino);
+            if (moved) {
+                tetromino_ = moved_tetromino;
+            }
+            bucket_.place(tetromino_);
+            return moved;
+        }
+
+        // Returns the removed rows as BucketT::full_rows() does.
+        int try_remove_full_rows_() {
+            trace::Span span{ "line_clear" };
+            assert(!tetromino_.is_undef() && "try_remove_full_rows_ has to be called before undefing tetromino");
+            int full_rows = features_.full_rows(tetromino_.top(), tetromino_.bottom());
+            int number_of_filled = 0;
+            if (full_rows) {
+                number_of_filled = bucket_.remove_full_rows(tetromino_.top(), tetromino_.bottom());
+                features_.remove_full_rows(bucket_, tetromino_.top(), full_rows);
+            }
+            score_ = std::min(score_ + rules_.line_scores[number_of_filled], GameStateT::MAX_COUNT);
+            auto remains_for_new_level = cleared_lines_ % 10;
+            cleared_lines_ = std::min(cleared_lines_ + number_of_filled, GameStateT::MAX_COUNT);
+            if (remains_for_new_level + number_of_filled >= 10 && level_ < GameStateT::MAX_LEVEL) {
+                ++level_;
+            }
+            common_game_speed_ = rules_.next_game_speed(common_game_speed_, level_);
+            return full_rows;
+        }
+
+    private:
+        GameRules rules_;
+        PreviewQueue previews_;
+        BucketT bucket_;
+        BoardFeaturesT features_;
+        Tetromino tetromino_;
+        size_t score_;
+        size_t level_;
+        size_t cleared_lines_;
+        long long last_update_; // in ns
+        long long game_speed_; // in ns
+        long long common_game_speed_; // in ns
+        bool game_over_;
+        bool speed_up_;
+    };
+
+    // Standard game on a 10 by 20 bucket.
+    using Tetris = BasicTetris<Bucket::COLS, Bucket::ROWS>;
+
+    static_assert(Tetris::SPAWN_X == SPAWN_X, "Standard spawn column differs");
+}
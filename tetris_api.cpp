@@ -0,0 +1,92 @@
+#include <new>
+
+#include "tetris.hpp"
+#include "tetris_api.h"
+
+static_assert(TETRIS_COLS == tetris::Bucket::COLS && TETRIS_ROWS == tetris::Bucket::ROWS, "Board size differs from the engine");
+static_assert(TETRIS_MAX_PREVIEW_DEPTH == tetris::PreviewQueue::MAX_DEPTH, "Preview depth differs from the engine");
+static_assert(TETRIS_TICK == static_cast<int>(tetris::Action::Tick), "Actions differ from the engine");
+static_assert(TETRIS_Z == static_cast<int>(tetris::BlockStyle::Z), "Block styles differ from the engine");
+static_assert(sizeof(tetris::Bucket::RowT) == sizeof(uint16_t) && sizeof(tetris::BlockStyle) == sizeof(uint8_t),
+    "Buffers don't have the types of the API");
+
+struct tetris_game final {
+    tetris::Tetris game;
+};
+
+namespace {
+
+    bool step(tetris_game* game, uint32_t action) {
+        return game->game.act(static_cast<tetris::Action>(action));
+    }
+}
+
+extern "C" {
+
+    uint32_t tetris_api_version(void) {
+        return TETRIS_API_VERSION;
+    }
+
+    tetris_game* tetris_create(uint64_t seed, uint32_t preview_depth) {
+        if (preview_depth < 1 || preview_depth > TETRIS_MAX_PREVIEW_DEPTH) {
+            return nullptr;
+        }
+        return new (std::nothrow) tetris_game{ tetris::Tetris{ seed, preview_depth } };
+    }
+
+    tetris_game* tetris_clone(const tetris_game* game) {
+        return new (std::nothrow) tetris_game{ *game };
+    }
+
+    void tetris_destroy(tetris_game* game) {
+        delete game;
+    }
+
+    void tetris_reset(tetris_game* game, uint64_t seed) {
+        game->game.reset(seed);
+    }
+
+    int tetris_step(tetris_game* game, uint32_t action) {
+        if (action > TETRIS_TICK) {
+            return -1;
+        }
+        return step(game, action);
+    }
+
+    void tetris_step_batch(tetris_game* const* games, const uint8_t* actions, uint8_t* changed, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            bool game_changed = actions[i] <= TETRIS_TICK && step(games[i], actions[i]);
+            if (changed) {
+                changed[i] = game_changed;
+            }
+        }
+    }
+
+    const uint16_t* tetris_board(const tetris_game* game) {
+        return game->game.bucket().data();
+    }
+
+    const uint8_t* tetris_previews(const tetris_game* game) {
+        return reinterpret_cast<const uint8_t*>(game->game.previews());
+    }
+
+    uint32_t tetris_preview_depth(const tetris_game* game) {
+        return static_cast<uint32_t>(game->game.preview_depth());
+    }
+
+    uint64_t tetris_score(const tetris_game* game) {
+        return game->game.score();
+    }
+
+    uint64_t tetris_cleared_lines(const tetris_game* game) {
+        return game->game.cleared_lines();
+    }
+
+    uint32_t tetris_level(const tetris_game* game) {
+        return static_cast<uint32_t>(game->game.level());
+    }
+
+    int tetris_game_over(const tetris_game* game) {
+        return game->game.game_over();
+    }
+}
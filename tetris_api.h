@@ -0,0 +1,94 @@
+#ifndef TETRIS_API_H
+#define TETRIS_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* C API of libtetris, for driving games in process, e.g. from training harnesses through a foreign function
+* interface. Games are the standard 10x20 ones with the bag generator, like terminal-tetris plays.
+*
+* Functions taking a game require a valid one, except tetris_destroy(). A game isn't thread safe, distinct games
+* can be used from different threads. The ABI only grows within a major TETRIS_API_VERSION.
+*/
+
+#if defined(_WIN32)
+#  if defined(TETRIS_BUILD_LIBRARY)
+#    define TETRIS_API __declspec(dllexport)
+#  else
+#    define TETRIS_API __declspec(dllimport)
+#  endif
+#else
+#  define TETRIS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TETRIS_API_VERSION 1
+
+#define TETRIS_COLS 10
+#define TETRIS_ROWS 20
+#define TETRIS_MAX_PREVIEW_DEPTH 9
+
+/* Actions of tetris_step(). */
+enum {
+    TETRIS_LEFT,
+    TETRIS_RIGHT,
+    TETRIS_ROTATE_RIGHT,
+    TETRIS_ROTATE_LEFT,
+    TETRIS_SOFT_DROP,
+    TETRIS_TICK
+};
+
+/* Block styles in the preview queue. */
+enum {
+    TETRIS_I,
+    TETRIS_J,
+    TETRIS_L,
+    TETRIS_O,
+    TETRIS_S,
+    TETRIS_T,
+    TETRIS_Z
+};
+
+typedef struct tetris_game tetris_game;
+
+/* TETRIS_API_VERSION of the library, which may differ from the one of the header. */
+TETRIS_API uint32_t tetris_api_version(void);
+
+/* Starts a game with the random sequence of the seed, showing preview_depth upcoming styles, 1 to
+   TETRIS_MAX_PREVIEW_DEPTH. Returns NULL if the depth is out of range or memory ran out. */
+TETRIS_API tetris_game* tetris_create(uint64_t seed, uint32_t preview_depth);
+/* Returns a game that continues exactly like this one, NULL if memory ran out. */
+TETRIS_API tetris_game* tetris_clone(const tetris_game* game);
+TETRIS_API void tetris_destroy(tetris_game* game);
+/* Starts the game over with the random sequence of the seed. */
+TETRIS_API void tetris_reset(tetris_game* game, uint64_t seed);
+
+/* Applies an action, TETRIS_TICK advances gravity by one tick. Returns 1 if the board changed, 0 if it didn't
+   and -1 if the action is unknown. */
+TETRIS_API int tetris_step(tetris_game* game, uint32_t action);
+/* Applies actions[i] to games[i] for count games, which must be distinct. Stores whether the board changed to
+   changed[i] unless changed is NULL. Unknown actions change nothing. */
+TETRIS_API void tetris_step_batch(tetris_game* const* games, const uint8_t* actions, uint8_t* changed, size_t count);
+
+/* The TETRIS_ROWS rows of the board from the top, including the falling tetromino. Bit x of a row is set if
+   column x is occupied. The pointer stays valid for the life of the game, and its rows follow the game. */
+TETRIS_API const uint16_t* tetris_board(const tetris_game* game);
+/* Styles of the upcoming tetrominoes from the next one, the preview depth of them. The pointer is valid until
+   the game is stepped, reset or destroyed. */
+TETRIS_API const uint8_t* tetris_previews(const tetris_game* game);
+TETRIS_API uint32_t tetris_preview_depth(const tetris_game* game);
+
+TETRIS_API uint64_t tetris_score(const tetris_game* game);
+TETRIS_API uint64_t tetris_cleared_lines(const tetris_game* game);
+TETRIS_API uint32_t tetris_level(const tetris_game* game);
+TETRIS_API int tetris_game_over(const tetris_game* game);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris_api.h"
+
+/*
+* Checks the C API from C: clones continue exactly like their originals, tetris_step_batch() steps games like
+* tetris_step() does one by one, and out of range preview depths and unknown actions are rejected without
+* changing a game.
+*
+* Usage: tetris-api-test [STEPS]
+*/
+
+#define GAMES 16
+#define CLONE_EVERY 997
+
+static uint64_t random_state = 7;
+
+static uint32_t random_bounded(uint32_t bound) {
+    /* xorshift64* */
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32) % bound;
+}
+
+/* Actions that mostly let tetrominoes fall, so games lock, clear lines and end. */
+static uint32_t random_action(void) {
+    uint32_t action = random_bounded(10);
+    return action < 5 ? action : TETRIS_TICK;
+}
+
+static int same_game(const tetris_game* a, const tetris_game* b) {
+    return memcmp(tetris_board(a), tetris_board(b), TETRIS_ROWS * sizeof(uint16_t)) == 0
+        && tetris_preview_depth(a) == tetris_preview_depth(b)
+        && memcmp(tetris_previews(a), tetris_previews(b), tetris_preview_depth(a)) == 0
+        && tetris_score(a) == tetris_score(b)
+        && tetris_cleared_lines(a) == tetris_cleared_lines(b)
+        && tetris_level(a) == tetris_level(b)
+        && tetris_game_over(a) == tetris_game_over(b);
+}
+
+static size_t check_depths(void) {
+    size_t failures = 0;
+    uint32_t depth;
+    tetris_game* game;
+    if (tetris_api_version() != TETRIS_API_VERSION) {
+        fprintf(stderr, "Library version %u, header version %d\n", (unsigned)tetris_api_version(), TETRIS_API_VERSION);
+        ++failures;
+    }
+    for (depth = 0; depth <= TETRIS_MAX_PREVIEW_DEPTH + 1; ++depth) {
+        int valid = depth >= 1 && depth <= TETRIS_MAX_PREVIEW_DEPTH;
+        game = tetris_create(1, depth);
+        if ((game != NULL) != valid || (game && tetris_preview_depth(game) != depth)) {
+            fprintf(stderr, "Preview depth %u is %s\n", (unsigned)depth, game ? "accepted" : "rejected");
+            ++failures;
+        }
+        tetris_destroy(game);
+    }
+    game = tetris_create(1, UINT32_MAX);
+    if (game) {
+        fprintf(stderr, "Preview depth %u is accepted\n", (unsigned)UINT32_MAX);
+        ++failures;
+    }
+    tetris_destroy(game);
+    return failures;
+}
+
+/* Unknown actions, from the one after TETRIS_TICK up, leave the game as it is. */
+static size_t check_unknown_actions(tetris_game* game, tetris_game* copy) {
+    static const uint32_t unknown[] = { TETRIS_TICK + 1, 0xFF, UINT32_MAX };
+    size_t failures = 0;
+    size_t i;
+    uint8_t action;
+    uint8_t changed = 1;
+    for (i = 0; i < sizeof unknown / sizeof unknown[0]; ++i) {
+        if (tetris_step(game, unknown[i]) != -1 || !same_game(game, copy)) {
+            fprintf(stderr, "tetris_step() takes unknown action %u\n", (unsigned)unknown[i]);
+            ++failures;
+        }
+    }
+    action = TETRIS_TICK + 1;
+    tetris_step_batch(&game, &action, &changed, 1);
+    if (changed || !same_game(game, copy)) {
+        fprintf(stderr, "tetris_step_batch() takes unknown action %u\n", (unsigned)action);
+        ++failures;
+    }
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    size_t steps = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000;
+    tetris_game* games[GAMES];
+    tetris_game* singles[GAMES];
+    tetris_game* clones[GAMES];
+    uint8_t actions[GAMES];
+    uint8_t changed[GAMES];
+    uint64_t next_seed = 1 + GAMES;
+    size_t failures = check_depths();
+    size_t ended = 0;
+    size_t clears = 0;
+    size_t step;
+    size_t i;
+
+    for (i = 0; i < GAMES; ++i) {
+        games[i] = tetris_create(1 + i, 1 + i % TETRIS_MAX_PREVIEW_DEPTH);
+        singles[i] = tetris_create(1 + i, 1 + i % TETRIS_MAX_PREVIEW_DEPTH);
+        clones[i] = tetris_clone(games[i]);
+        if (!games[i] || !singles[i] || !clones[i]) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+    for (step = 0; step < steps; ++step) {
+        for (i = 0; i < GAMES; ++i) {
+            if (tetris_game_over(games[i])) {
+                tetris_reset(games[i], next_seed);
+                tetris_reset(singles[i], next_seed);
+                tetris_reset(clones[i], next_seed++);
+                ++ended;
+            }
+            if (step % CLONE_EVERY == i) {
+                /* A fresh clone mid-game, the old one has to keep up until then. */
+                tetris_destroy(clones[i]);
+                clones[i] = tetris_clone(games[i]);
+                if (!clones[i]) {
+                    fprintf(stderr, "Out of memory\n");
+                    return 1;
+                }
+                failures += check_unknown_actions(clones[i], games[i]);
+            }
+            actions[i] = (uint8_t)random_action();
+        }
+        tetris_step_batch(games, actions, changed, GAMES);
+        for (i = 0; i < GAMES; ++i) {
+            int single = tetris_step(singles[i], actions[i]);
+            int clone = tetris_step(clones[i], actions[i]);
+            clears += tetris_cleared_lines(games[i]) != 0;
+            if (single != changed[i] || clone != changed[i] || !same_game(games[i], singles[i]) || !same_game(games[i], clones[i])) {
+                if (failures++ < 10) {
+                    fprintf(stderr, "Game %u differs after step %u\n", (unsigned)i, (unsigned)step);
+                }
+            }
+        }
+    }
+    if (!ended || !clears) {
+        fprintf(stderr, "%u games ended and %u steps had lines cleared in %u steps, too few to cover the rules\n",
+            (unsigned)ended, (unsigned)clears, (unsigned)steps);
+        ++failures;
+    }
+    for (i = 0; i < GAMES; ++i) {
+        tetris_destroy(games[i]);
+        tetris_destroy(singles[i]);
+        tetris_destroy(clones[i]);
+    }
+    if (failures) {
+        fprintf(stderr, "%u checks failed\n", (unsigned)failures);
+        return 1;
+    }
+    fprintf(stderr, "%u steps of %d games match through clones, single steps and batches\n", (unsigned)steps, GAMES);
+    return 0;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tetris {
+
+    // Runs loops of independent tasks on a fixed set of threads. Every thread starts on its own share of the
+    // indices and steals half of the remaining share of another thread once it runs out, so uneven tasks
+    // still keep all threads busy.
+    class ThreadPool final {
+    public:
+        // The calling thread of parallel_for() takes part in the work, so threads - 1 workers are started.
+        explicit ThreadPool(size_t threads = std::max(std::thread::hardware_concurrency(), 1u)) :
+            slots_(std::max<size_t>(threads, 1)),
+            generation_{ 0 },
+            remaining_{ 0 },
+            task_{ nullptr },
+            context_{ nullptr },
+            stopping_{ false }
+        {
+            for (size_t i = 1; i < slots_.size(); ++i) {
+                workers_.emplace_back([this, i] { work_(i); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock{ mutex_ };
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (auto&& worker : workers_) {
+                worker.join();
+            }
+        }
+
+        size_t size() const noexcept { return slots_.size(); }
+
+        // Calls task(i) for every i in [0, count) and returns once all of them are done.
+        // Tasks must not call parallel_for() themselves.
+        template <typename Task>
+        void parallel_for(size_t count, Task&& task) {
+            if (!count) {
+                return;
+            }
+            if (slots_.size() == 1 || count == 1) {
+                for (size_t i = 0; i < count; ++i) {
+                    task(i);
+                }
+                return;
+            }
+            uint64_t generation;
+            {
+                std::lock_guard lock{ mutex_ };
+                assert(remaining_.load() == 0 && "parallel_for is not reentrant");
+                generation = ++generation_;
+                task_ = [](void* context, size_t i) { (*static_cast<std::remove_reference_t<Task>*>(context))(i); };
+                context_ = &task;
+                remaining_.store(count, std::memory_order_relaxed);
+                size_t share = count / slots_.size();
+                size_t extra = count % slots_.size();
+                size_t begin = 0;
+                for (size_t i = 0; i < slots_.size(); ++i) {
+                    size_t end = begin + share + (i < extra);
+                    slots_[i].assign(generation, begin, end);
+                    begin = end;
+                }
+            }
+            wake_.notify_all();
+            run_(0, generation);
+            // Workers may still be finishing the tasks they've taken.
+            while (remaining_.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        // Share of the indices of one thread. Its owner takes indices from the front, thieves take the back half.
+        struct alignas(64) Slot final {
+            void assign(uint64_t generation, size_t begin, size_t end) {
+                std::lock_guard lock{ mutex };
+                this->generation = generation;
+                this->begin = begin;
+                this->end = end;
+            }
+
+            std::mutex mutex;
+            uint64_t generation = 0;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+    private:
+        void work_(size_t slot) {
+            uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock lock{ mutex_ };
+                    wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+                    if (stopping_) {
+                        return;
+                    }
+                    seen = generation_;
+                }
+                run_(slot, seen);
+            }
+        }
+
+        // Runs tasks of the generation until there are none left to take or steal.
+        void run_(size_t slot, uint64_t generation) {
+            auto& own = slots_[slot];
+            while (true) {
+                size_t i;
+                if (!take_(own, generation, i) && !steal_(slot, generation, i)) {
+                    return;
+                }
+                task_(context_, i);
+                remaining_.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        static bool take_(Slot& slot, uint64_t generation, size_t& i) {
+            std::lock_guard lock{ slot.mutex };
+            if (slot.generation != generation || slot.begin == slot.end) {
+                return false;
+            }
+            i = slot.begin++;
+            return true;
+        }
+
+        // Moves the back half of another share to the slot and takes its first index.
+        bool steal_(size_t slot, uint64_t generation, size_t& i) {
+            for (size_t attempt = 1; attempt < slots_.size(); ++attempt) {
+                auto& victim = slots_[(slot + attempt) % slots_.size()];
+                size_t begin;
+                size_t end;
+                {
+                    std::lock_guard lock{ victim.mutex };
+                    if (victim.generation != generation || victim.begin == victim.end) {
+                        continue;
+                    }
+                    begin = victim.begin + (victim.end - victim.begin) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+                slots_[slot].assign(generation, begin + 1, end);
+                i = begin;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        std::vector<Slot> slots_;
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        uint64_t generation_;
+        std::atomic<size_t> remaining_;
+        void (*task_)(void*, size_t);
+        void* context_;
+        bool stopping_;
+    };
+}
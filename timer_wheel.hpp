@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tetris {
+
+    // Hashed timer wheel for many timers with deadlines a few seconds ahead at most, like gravity of games.
+    // Timers are identified by small indices and linked into the slot of their deadline, so scheduling and
+    // cancelling are O(1) and advancing only visits the slots the clock passed. Deadlines are in ns and
+    // fire up to one slot late; deadlines further than the wheel spans are checked again every turn.
+    class TimerWheel final {
+    public:
+        static constexpr long long SLOT_NS = 1'000'000;
+        static constexpr size_t SLOTS = 2048;
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+    public:
+        explicit TimerWheel(long long now) :
+            slots_(SLOTS, NONE),
+            tick_{ now / SLOT_NS - 1 },
+            size_{ 0 }
+        {}
+
+        // Schedules the timer at the deadline, instead of its previous one.
+        void schedule(uint32_t id, long long deadline) {
+            if (id >= nodes_.size()) {
+                nodes_.resize(std::max<size_t>(id + 1, nodes_.size() * 2), Node{ NONE, NONE, 0, 0, false });
+            }
+            cancel(id);
+            auto& node = nodes_[id];
+            node.deadline = deadline;
+            node.scheduled = true;
+            // Slots up to tick_ were visited already.
+            node.slot = static_cast<uint32_t>(std::max(deadline / SLOT_NS, tick_ + 1) % SLOTS);
+            auto& head = slots_[node.slot];
+            node.prev = NONE;
+            node.next = head;
+            if (head != NONE) {
+                nodes_[head].prev = id;
+            }
+            head = id;
+            ++size_;
+        }
+
+        void cancel(uint32_t id) noexcept {
+            if (id >= nodes_.size() || !nodes_[id].scheduled) {
+                return;
+            }
+            auto& node = nodes_[id];
+            if (node.prev != NONE) {
+                nodes_[node.prev].next = node.next;
+            }
+            else {
+                slots_[node.slot] = node.next;
+            }
+            if (node.next != NONE) {
+                nodes_[node.next].prev = node.prev;
+            }
+            node.scheduled = false;
+            --size_;
+        }
+
+        // Calls expire(id) for every timer with a deadline up to now, in slot order. expire() may schedule
+        // and cancel timers.
+        template <typename Expire>
+        void advance(long long now, Expire&& expire) {
+            // Slots are visited once their time has passed completely.
+            auto last = now / SLOT_NS - 1;
+            // Past a full turn every slot is visited once, the remaining timers are all in the future.
+            auto ticks = std::min<long long>(last - tick_, SLOTS);
+            for (long long i = 0; i < ticks; ++i) {
+                ++tick_;
+                auto id = slots_[static_cast<size_t>(tick_) % SLOTS];
+                while (id != NONE) {
+                    auto next = nodes_[id].next;
+                    if (nodes_[id].deadline <= now) {
+                        cancel(id);
+                        expire(id);
+                    }
+                    id = next;
+                }
+            }
+            tick_ = std::max(tick_, last);
+        }
+
+        // Time at which advance() visits the next slot, in ns.
+        long long next_tick_time() const noexcept { return (tick_ + 2) * SLOT_NS; }
+
+        bool scheduled(uint32_t id) const noexcept { return id < nodes_.size() && nodes_[id].scheduled; }
+        size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return !size_; }
+
+    private:
+        struct Node final {
+            uint32_t prev;
+            uint32_t next;
+            long long deadline;
+            uint32_t slot;
+            bool scheduled;
+        };
+
+    private:
+        std::vector<uint32_t> slots_;
+        std::vector<Node> nodes_;
+        long long tick_; // last visited slot, in SLOT_NS since the clock's epoch
+        size_t size_;
+    };
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(TETRIS_TRACE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(TETRIS_TRACE) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Trace spans of the game loop for chrome://tracing and Perfetto. Every thread records the spans it ends into
+// its own ring buffer, which keeps the last RING_CAPACITY of them, without locks; export_json() writes all
+// buffers as Chrome trace events. Spans are compiled out unless TETRIS_TRACE is defined.
+
+namespace tetris::trace {
+
+#ifdef TETRIS_TRACE
+    inline constexpr bool ENABLED = true;
+
+    // Timestamp counter where there is one, it's read several times faster than the steady clock.
+    inline uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    struct Event final {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> begin;
+        std::atomic<uint64_t> end;
+    };
+
+    // Written by its thread only. An event is complete once head passes it, and is overwritten
+    // RING_CAPACITY events later.
+    struct ThreadBuffer final {
+        static constexpr size_t RING_CAPACITY = 1 << 16;
+
+        explicit ThreadBuffer(size_t id) : id{ id }, head{ 0 }, events{ new Event[RING_CAPACITY] } {}
+
+        void push(const char* name, uint64_t begin, uint64_t end) noexcept {
+            auto position = head.load(std::memory_order_relaxed);
+            auto& event = events[position & (RING_CAPACITY - 1)];
+            event.name.store(name, std::memory_order_relaxed);
+            event.begin.store(begin, std::memory_order_relaxed);
+            event.end.store(end, std::memory_order_relaxed);
+            head.store(position + 1, std::memory_order_release);
+        }
+
+        size_t id;
+        std::atomic<uint64_t> head;
+        std::unique_ptr<Event[]> events;
+    };
+
+    class Registry final {
+    public:
+        static Registry& instance() {
+            static Registry registry;
+            return registry;
+        }
+
+        ThreadBuffer& add() {
+            std::lock_guard lock{ mutex_ };
+            threads_.push_back(std::make_unique<ThreadBuffer>(threads_.size() + 1));
+            return *threads_.back();
+        }
+
+        // Writes the spans in the buffers as Chrome trace events. Spans being overwritten while they are
+        // read are left out. Returns whether the file was written.
+        bool export_json(const char* path) {
+            // Timestamps are converted to µs by their rate against the steady clock since the registry started.
+            // Spans begun before that get negative times.
+            auto ticks = now() - start_ticks_;
+            auto elapsed = std::chrono::steady_clock::now() - start_time_;
+            double us_per_tick = std::chrono::duration<double, std::micro>(elapsed).count() / std::max<uint64_t>(ticks, 1);
+            std::FILE* file = std::fopen(path, "w");
+            if (!file) {
+                return false;
+            }
+            std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+            std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"terminal-tetris\"}}");
+            std::lock_guard lock{ mutex_ };
+            for (auto&& thread : threads_) {
+                auto head = thread->head.load(std::memory_order_acquire);
+                auto first = head > ThreadBuffer::RING_CAPACITY ? head - ThreadBuffer::RING_CAPACITY : 0;
+                for (auto position = first; position < head; ++position) {
+                    auto& event = thread->events[position & (ThreadBuffer::RING_CAPACITY - 1)];
+                    auto name = event.name.load(std::memory_order_relaxed);
+                    auto begin = event.begin.load(std::memory_order_relaxed);
+                    auto end = event.end.load(std::memory_order_relaxed);
+                    // The thread may have wrapped around onto the event while it was read.
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (thread->head.load(std::memory_order_relaxed) - position > ThreadBuffer::RING_CAPACITY) {
+                        continue;
+                    }
+                    auto ts = static_cast<double>(static_cast<int64_t>(begin - start_ticks_)) * us_per_tick;
+                    auto duration = static_cast<double>(end - begin) * us_per_tick;
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                        name, thread->id, ts, duration);
+                }
+            }
+            std::fprintf(file, "\n]}\n");
+            return std::fclose(file) == 0;
+        }
+
+    private:
+        Registry() :
+            start_ticks_{ now() },
+            start_time_{ std::chrono::steady_clock::now() }
+        {}
+
+    private:
+        uint64_t start_ticks_;
+        std::chrono::steady_clock::time_point start_time_;
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+    };
+
+    inline ThreadBuffer& local() {
+        thread_local ThreadBuffer& buffer = Registry::instance().add();
+        return buffer;
+    }
+
+    // Records the time from its construction to its destruction under the name, which has to outlive the export.
+    class Span final {
+    public:
+        explicit Span(const char* name) noexcept : name_{ name }, begin_{ now() } {}
+
+        ~Span() {
+            local().push(name_, begin_, now());
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name_;
+        uint64_t begin_;
+    };
+
+    inline bool export_json(const char* path) { return Registry::instance().export_json(path); }
+#else
+    inline constexpr bool ENABLED = false;
+
+    class Span final {
+    public:
+        explicit Span(const char*) noexcept {}
+    };
+
+    inline bool export_json(const char*) { return false; }
+#endif
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace tetris {
+
+    // Search result cached for a state.
+    struct TranspositionEntry final {
+        float value;
+        uint16_t depth; // depth the value was searched to
+        uint8_t flags; // left to the search, e.g. to mark bounds
+    };
+
+    enum class ReplacementPolicy : uint8_t {
+        // A new entry always evicts the slot its hash maps to.
+        Always,
+        // A new entry evicts entries of earlier searches first, then the shallowest entry,
+        // and is dropped if it's shallower than all entries of the current search in its bucket.
+        DepthPreferred
+    };
+
+    // Fixed-size table of search results keyed by state hashes, e.g. Tetris::hash(), shared by any number of
+    // threads without locks. A bucket of WAYS entries fills a cache line. Every entry is stored as its data and
+    // its data XORed with the hash, so a read racing a write is seen as a different key rather than a torn entry.
+    class TranspositionTable final {
+    public:
+        // The table takes at most the given number of bytes, rounded down to a power of two number of buckets.
+        TranspositionTable(size_t bytes, ReplacementPolicy policy) :
+            bucket_count_{ bucket_count_for_(bytes) },
+            buckets_{ new Bucket[bucket_count_] },
+            policy_{ policy },
+            generation_{ 1 }
+        {
+            clear();
+        }
+
+        // Returns whether the hash is in the table and if so, its entry.
+        bool probe(uint64_t hash, TranspositionEntry& entry) noexcept {
+            auto& bucket = buckets_[hash & (bucket_count_ - 1)];
+            for (auto&& slot : bucket.slots) {
+                auto data = slot.data.load(std::memory_order_relaxed);
+                auto check = slot.check.load(std::memory_order_relaxed);
+                if (data && (data ^ check) == hash) {
+                    entry = unpack_(data);
+                    counters_().hits.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            counters_().misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        void store(uint64_t hash, const TranspositionEntry& entry) noexcept {
+            auto& bucket = buckets_[hash & (bucket_count_ - 1)];
+            auto generation = generation_.load(std::memory_order_relaxed);
+            Slot* victim = &bucket.slots[hash >> (64 - WAY_BITS)];
+            if (policy_ == ReplacementPolicy::DepthPreferred) {
+                int victim_priority = INT32_MAX;
+                for (auto&& slot : bucket.slots) {
+                    auto data = slot.data.load(std::memory_order_relaxed);
+                    if ((data ^ slot.check.load(std::memory_order_relaxed)) == hash && data) {
+                        victim = &slot;
+                        break;
+                    }
+                    // Entries of the current search are kept over older ones, then deeper ones over shallower ones.
+                    int priority = (generation_of_(data) == generation) << 16 | unpack_(data).depth;
+                    if (priority < victim_priority) {
+                        victim = &slot;
+                        victim_priority = priority;
+                    }
+                }
+                auto data = victim->data.load(std::memory_order_relaxed);
+                if ((data ^ victim->check.load(std::memory_order_relaxed)) != hash
+                    && generation_of_(data) == generation && unpack_(data).depth > entry.depth) {
+                    return;
+                }
+            }
+            auto data = pack_(entry, generation);
+            victim->data.store(data, std::memory_order_relaxed);
+            victim->check.store(data ^ hash, std::memory_order_relaxed);
+            counters_().stores.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Marks the entries stored so far as belonging to an earlier search, so they are evicted first.
+        void new_search() noexcept {
+            uint8_t generation = generation_.load(std::memory_order_relaxed) + 1;
+            // Generation 0 marks empty slots.
+            generation_.store(generation ? generation : 1, std::memory_order_relaxed);
+        }
+
+        // Empties the table and resets the counters. Must not run concurrently with other calls.
+        void clear() noexcept {
+            for (size_t i = 0; i < bucket_count_; ++i) {
+                for (auto&& slot : buckets_[i].slots) {
+                    slot.data.store(0, std::memory_order_relaxed);
+                    slot.check.store(0, std::memory_order_relaxed);
+                }
+            }
+            for (auto&& counters : counters_shards_) {
+                counters.hits.store(0, std::memory_order_relaxed);
+                counters.misses.store(0, std::memory_order_relaxed);
+                counters.stores.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        size_t capacity() const noexcept { return bucket_count_ * WAYS; }
+        uint64_t hits() const noexcept { return sum_(&Counters::hits); }
+        uint64_t misses() const noexcept { return sum_(&Counters::misses); }
+        uint64_t stores() const noexcept { return sum_(&Counters::stores); }
+
+    private:
+        static constexpr int WAY_BITS = 2;
+        static constexpr size_t WAYS = 1 << WAY_BITS;
+        static constexpr size_t COUNTER_SHARDS = 16;
+
+        struct Slot final {
+            std::atomic<uint64_t> check;
+            std::atomic<uint64_t> data; // value, depth, flags and generation of the entry, 0 if empty
+        };
+
+        struct alignas(64) Bucket final {
+            std::array<Slot, WAYS> slots;
+        };
+
+        // Threads count to different cache lines, so counting doesn't make them contend on one.
+        struct alignas(64) Counters final {
+            std::atomic<uint64_t> hits;
+            std::atomic<uint64_t> misses;
+            std::atomic<uint64_t> stores;
+        };
+
+    private:
+        static size_t bucket_count_for_(size_t bytes) noexcept {
+            size_t count = 1;
+            while (count * 2 * sizeof(Bucket) <= bytes) {
+                count *= 2;
+            }
+            return count;
+        }
+
+        static uint64_t pack_(const TranspositionEntry& entry, uint8_t generation) noexcept {
+            uint32_t value;
+            std::memcpy(&value, &entry.value, sizeof(value));
+            return value
+                | static_cast<uint64_t>(entry.depth) << 32
+                | static_cast<uint64_t>(entry.flags) << 48
+                | static_cast<uint64_t>(generation) << 56;
+        }
+
+        static TranspositionEntry unpack_(uint64_t data) noexcept {
+            TranspositionEntry entry;
+            auto value = static_cast<uint32_t>(data);
+            std::memcpy(&entry.value, &value, sizeof(value));
+            entry.depth = static_cast<uint16_t>(data >> 32);
+            entry.flags = static_cast<uint8_t>(data >> 48);
+            return entry;
+        }
+
+        static uint8_t generation_of_(uint64_t data) noexcept { return static_cast<uint8_t>(data >> 56); }
+
+        Counters& counters_() noexcept {
+            static thread_local size_t shard = std::hash<std::thread::id>{}(std::this_thread::get_id()) % COUNTER_SHARDS;
+            return counters_shards_[shard];
+        }
+
+        uint64_t sum_(std::atomic<uint64_t> Counters::* counter) const noexcept {
+            uint64_t sum = 0;
+            for (auto&& counters : counters_shards_) {
+                sum += (counters.*counter).load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+    private:
+        size_t bucket_count_;
+        std::unique_ptr<Bucket[]> buckets_;
+        ReplacementPolicy policy_;
+        std::atomic<uint8_t> generation_;
+        std::array<Counters, COUNTER_SHARDS> counters_shards_;
+    };
+}
@@ -0,0 +1,176 @@
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "tetris.hpp"
+#include "transposition_table.hpp"
+
+// Checks TranspositionTable: probes find what was stored, both replacement policies evict the entries they
+// document, and entries read while other threads overwrite them are never torn.
+//
+// Usage: tetris-transposition-table-test
+
+namespace {
+
+    using tetris::ReplacementPolicy;
+    using tetris::TranspositionEntry;
+    using tetris::TranspositionTable;
+
+    // 8 buckets of 4 entries.
+    constexpr size_t SMALL_TABLE_BYTES = 512;
+
+    size_t failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::fprintf(stderr, "Failed: %s\n", what);
+            ++failures;
+        }
+    }
+
+    // Hashes of the same bucket, differing in their top bits, which pick the way of ReplacementPolicy::Always.
+    uint64_t hash_in_bucket(uint64_t bucket, uint64_t i) noexcept {
+        return bucket | (i + 1) << 8 | (i & 3) << 62;
+    }
+
+    // The entry threads store for a hash, so readers know what they may see.
+    TranspositionEntry entry_for(uint64_t hash) noexcept {
+        return TranspositionEntry{ static_cast<float>(hash >> 40), static_cast<uint16_t>(hash >> 8), static_cast<uint8_t>(hash >> 24) };
+    }
+
+    bool same(const TranspositionEntry& a, const TranspositionEntry& b) noexcept {
+        return a.value == b.value && a.depth == b.depth && a.flags == b.flags;
+    }
+
+    void test_probe_and_store() {
+        TranspositionTable table{ SMALL_TABLE_BYTES, ReplacementPolicy::Always };
+        check(table.capacity() == 32, "capacity is the buckets that fit times their ways");
+        TranspositionEntry entry{};
+        check(!table.probe(42, entry), "empty table misses");
+        table.store(42, TranspositionEntry{ 1.5f, 3, 7 });
+        check(table.probe(42, entry) && same(entry, TranspositionEntry{ 1.5f, 3, 7 }), "stored entry is found");
+        check(!table.probe(42 + (uint64_t{ 1 } << 20), entry), "other hash of the bucket misses");
+        table.store(42, TranspositionEntry{ -2.0f, 1, 0 });
+        check(table.probe(42, entry) && same(entry, TranspositionEntry{ -2.0f, 1, 0 }), "storing a hash again replaces it");
+        check(table.hits() == 2 && table.misses() == 2 && table.stores() == 2, "counters count probes and stores");
+        table.clear();
+        check(!table.probe(42, entry) && table.hits() == 0 && table.misses() == 1, "clear empties the table and counters");
+    }
+
+    void test_always_replacement() {
+        TranspositionTable table{ SMALL_TABLE_BYTES, ReplacementPolicy::Always };
+        // Same bucket and way: the later store evicts the earlier one, whatever its depth.
+        uint64_t first = 5 | uint64_t{ 1 } << 8;
+        uint64_t second = 5 | uint64_t{ 2 } << 8;
+        TranspositionEntry entry{};
+        table.store(first, TranspositionEntry{ 1, 60, 0 });
+        table.store(second, TranspositionEntry{ 2, 1, 0 });
+        check(!table.probe(first, entry), "always evicts the slot of the way");
+        check(table.probe(second, entry) && entry.value == 2, "always keeps the newest entry");
+        // Different ways of a bucket don't evict each other.
+        for (uint64_t i = 0; i < 4; ++i) {
+            table.store(hash_in_bucket(3, i), entry_for(hash_in_bucket(3, i)));
+        }
+        for (uint64_t i = 0; i < 4; ++i) {
+            check(table.probe(hash_in_bucket(3, i), entry), "always keeps entries of other ways");
+        }
+    }
+
+    void test_depth_preferred_replacement() {
+        TranspositionTable table{ SMALL_TABLE_BYTES, ReplacementPolicy::DepthPreferred };
+        TranspositionEntry entry{};
+        for (uint64_t i = 0; i < 4; ++i) {
+            table.store(hash_in_bucket(1, i), TranspositionEntry{ static_cast<float>(i), static_cast<uint16_t>(10 + i), 0 });
+        }
+        // A full bucket of the current search drops shallower entries.
+        table.store(hash_in_bucket(1, 4), TranspositionEntry{ 4, 5, 0 });
+        check(!table.probe(hash_in_bucket(1, 4), entry), "depth preferred drops an entry shallower than the bucket");
+        // A deeper one evicts the shallowest.
+        table.store(hash_in_bucket(1, 5), TranspositionEntry{ 5, 20, 0 });
+        check(table.probe(hash_in_bucket(1, 5), entry) && entry.depth == 20, "depth preferred stores a deeper entry");
+        check(!table.probe(hash_in_bucket(1, 0), entry), "depth preferred evicts the shallowest entry");
+        for (uint64_t i = 1; i < 4; ++i) {
+            check(table.probe(hash_in_bucket(1, i), entry), "depth preferred keeps the deeper entries");
+        }
+        // An entry of the same hash is replaced, even by a shallower one.
+        table.store(hash_in_bucket(1, 3), TranspositionEntry{ 33, 1, 0 });
+        check(table.probe(hash_in_bucket(1, 3), entry) && entry.depth == 1 && entry.value == 33, "depth preferred replaces the same hash");
+        // After a new search, entries of the previous one go first, however deep.
+        table.new_search();
+        table.store(hash_in_bucket(1, 6), TranspositionEntry{ 6, 0, 0 });
+        check(table.probe(hash_in_bucket(1, 6), entry), "depth preferred stores over entries of an earlier search");
+        table.store(hash_in_bucket(1, 7), TranspositionEntry{ 7, 1, 0 });
+        check(table.probe(hash_in_bucket(1, 6), entry) && table.probe(hash_in_bucket(1, 7), entry),
+            "depth preferred evicts earlier searches before the current one");
+        size_t kept = 0;
+        for (uint64_t i : { 1, 2, 3, 5 }) {
+            kept += table.probe(hash_in_bucket(1, i), entry);
+        }
+        check(kept == 2, "depth preferred evicted two entries of the earlier search");
+    }
+
+    // Writers overwrite a few buckets with entries derived from their hashes while readers probe them. A torn
+    // entry would be read back with the data of one hash under another.
+    void test_concurrent_access() {
+        constexpr size_t WRITERS = 2;
+        constexpr size_t READERS = 2;
+        constexpr size_t OPERATIONS = 500'000;
+        constexpr uint32_t KEYS = 4096;
+        for (auto policy : { ReplacementPolicy::Always, ReplacementPolicy::DepthPreferred }) {
+            TranspositionTable table{ SMALL_TABLE_BYTES, policy };
+            std::vector<size_t> torn(READERS);
+            std::vector<size_t> hits(READERS);
+            std::vector<std::thread> threads;
+            auto key = [](tetris::Random& random) {
+                uint64_t state = random.bounded(KEYS);
+                return tetris::split_mix64(state);
+            };
+            for (size_t i = 0; i < WRITERS; ++i) {
+                threads.emplace_back([&table, &key, i] {
+                    tetris::Random random{ i };
+                    for (size_t n = 0; n < OPERATIONS; ++n) {
+                        auto hash = key(random);
+                        table.store(hash, entry_for(hash));
+                    }
+                });
+            }
+            for (size_t i = 0; i < READERS; ++i) {
+                threads.emplace_back([&table, &key, &torn, &hits, i] {
+                    tetris::Random random{ WRITERS + i };
+                    TranspositionEntry entry{};
+                    for (size_t n = 0; n < OPERATIONS; ++n) {
+                        auto hash = key(random);
+                        if (table.probe(hash, entry)) {
+                            ++hits[i];
+                            torn[i] += !same(entry, entry_for(hash));
+                        }
+                    }
+                });
+            }
+            for (auto&& thread : threads) {
+                thread.join();
+            }
+            size_t torn_total = 0;
+            size_t hit_total = 0;
+            for (size_t i = 0; i < READERS; ++i) {
+                torn_total += torn[i];
+                hit_total += hits[i];
+            }
+            check(hit_total > 0, "concurrent readers find entries");
+            check(torn_total == 0, "concurrent readers never see torn entries");
+        }
+    }
+}
+
+int main() {
+    test_probe_and_store();
+    test_always_replacement();
+    test_depth_preferred_replacement();
+    test_concurrent_access();
+    if (failures) {
+        std::fprintf(stderr, "%zu checks failed\n", failures);
+        return 1;
+    }
+    std::fprintf(stderr, "All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,716 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bot.hpp"
+#include "tetris.hpp"
+#include "thread_pool.hpp"
+
+// Tunes the gravity curve, the scoring table and the bot weights by playing headless bot games. Every
+// generation, each candidate of the population plays the same fixed-seed batch of games, so candidates are
+// compared on common random numbers, and a genetic algorithm breeds the next population from the best ones.
+// Games are spread over forked worker processes pinned to cores. Workers claim games from a queue in shared
+// memory and publish their results there, without locks. If a worker crashes, the other workers finish the
+// batch, and the games it was playing are retried.
+//
+// The bot doesn't move a tetromino until gravity has had it for the reaction time, so faster gravity leaves it
+// fewer placements to reach, like a human player.
+//
+// Usage: tetris-tune [--params GROUPS] [--objective STAT] [--target VALUE] [--generations N] [--population N]
+//                    [--games N] [--max-pieces N] [--reaction-ticks N] [--beam N] [--depth N] [--workers N]
+//                    [--seed N] [--scaling]
+//
+// GROUPS is a comma separated list of bot, gravity and scoring, bot by default. STAT is score, lines, level,
+// pieces or survival, the share of games still going at --max-pieces. The objective is the mean of the stat
+// over the batch, or its distance to --target if one is given, to calibrate e.g. how long games last.
+// --scaling times the first batch with 1, 2, 4 and so on up to --workers workers instead of tuning.
+
+namespace {
+
+    long long steady_now() noexcept {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Options final {
+        std::vector<std::string> groups{ "bot" };
+        std::string objective = "score";
+        bool has_target = false;
+        double target = 0;
+        size_t generations = 10;
+        size_t population = 16;
+        size_t games = 16;
+        size_t max_pieces = 300;
+        size_t reaction_ticks = 4;
+        size_t beam = 4;
+        size_t depth = 2;
+        size_t workers = 0; // one per core by default
+        uint64_t seed = 1;
+        bool scaling = false;
+    };
+
+    // What a game is played with.
+    struct Candidate final {
+        tetris::BotWeights weights;
+        tetris::GameRules rules;
+    };
+
+    struct Parameter final {
+        const char* name;
+        const char* group;
+        double low;
+        double high;
+        double (*get)(const Candidate&);
+        void (*set)(Candidate&, double);
+    };
+
+    constexpr Parameter PARAMETERS[] = {
+        { "aggregate_height", "bot", -2, 0,
+            [](const Candidate& c) { return c.weights.aggregate_height; }, [](Candidate& c, double v) { c.weights.aggregate_height = v; } },
+        { "holes", "bot", -2, 0,
+            [](const Candidate& c) { return c.weights.holes; }, [](Candidate& c, double v) { c.weights.holes = v; } },
+        { "bumpiness", "bot", -2, 0,
+            [](const Candidate& c) { return c.weights.bumpiness; }, [](Candidate& c, double v) { c.weights.bumpiness = v; } },
+        { "wells", "bot", -2, 0,
+            [](const Candidate& c) { return c.weights.wells; }, [](Candidate& c, double v) { c.weights.wells = v; } },
+        { "cleared_lines", "bot", 0, 2,
+            [](const Candidate& c) { return c.weights.cleared_lines; }, [](Candidate& c, double v) { c.weights.cleared_lines = v; } },
+        { "initial_game_speed_ms", "gravity", 100, 2000,
+            [](const Candidate& c) { return c.rules.initial_game_speed / 1e6; },
+            [](Candidate& c, double v) { c.rules.initial_game_speed = std::llround(v * 1e6); } },
+        { "speed_decay_per_mille", "gravity", 500, 1000,
+            [](const Candidate& c) { return static_cast<double>(c.rules.speed_decay_per_mille); },
+            [](Candidate& c, double v) { c.rules.speed_decay_per_mille = static_cast<uint32_t>(std::lround(v)); } },
+        { "max_game_speed_ms", "gravity", 1, 200,
+            [](const Candidate& c) { return c.rules.max_game_speed / 1e6; },
+            [](Candidate& c, double v) { c.rules.max_game_speed = std::llround(v * 1e6); } },
+        { "single", "scoring", 0, 5000,
+            [](const Candidate& c) { return static_cast<double>(c.rules.line_scores[1]); },
+            [](Candidate& c, double v) { c.rules.line_scores[1] = static_cast<uint32_t>(std::lround(v)); } },
+        { "double", "scoring", 0, 5000,
+            [](const Candidate& c) { return static_cast<double>(c.rules.line_scores[2]); },
+            [](Candidate& c, double v) { c.rules.line_scores[2] = static_cast<uint32_t>(std::lround(v)); } },
+        { "triple", "scoring", 0, 5000,
+            [](const Candidate& c) { return static_cast<double>(c.rules.line_scores[3]); },
+            [](Candidate& c, double v) { c.rules.line_scores[3] = static_cast<uint32_t>(std::lround(v)); } },
+        { "tetris", "scoring", 0, 5000,
+            [](const Candidate& c) { return static_cast<double>(c.rules.line_scores[4]); },
+            [](Candidate& c, double v) { c.rules.line_scores[4] = static_cast<uint32_t>(std::lround(v)); } },
+    };
+
+    // The defaults seed the first genome unclamped, so they have to lie within the ranges.
+    constexpr bool defaults_in_ranges() {
+        for (auto&& parameter : PARAMETERS) {
+            double value = parameter.get(Candidate{});
+            if (value < parameter.low || value > parameter.high) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(defaults_in_ranges(), "A default of GameRules or BotWeights lies outside its parameter range");
+
+    using Genome = std::vector<double>; // values of the tuned parameters
+
+    // The genome may breed a maximum gravity slower than the initial one, it's capped at the initial one so that
+    // gravity never slows down at level 29.
+    Candidate make_candidate(const std::vector<const Parameter*>& parameters, const Genome& genome) {
+        Candidate candidate;
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            parameters[i]->set(candidate, genome[i]);
+        }
+        auto& rules = candidate.rules;
+        rules.max_game_speed = std::min(rules.max_game_speed, rules.initial_game_speed);
+        return candidate;
+    }
+
+    // Result of one game of a batch, in shared memory. The worker that claims the game writes the result and
+    // then publishes it with a release store of state, so it's read after an acquire load of DONE.
+    struct alignas(64) Slot final {
+        static constexpr uint32_t PENDING = 0;
+        static constexpr uint32_t CLAIMED = 1;
+        static constexpr uint32_t DONE = 2;
+        static constexpr uint32_t FAILED = 3; // crashed its worker on every attempt
+
+        std::atomic<uint32_t> state;
+        uint32_t attempts; // that crashed
+        uint64_t score;
+        uint32_t lines;
+        uint32_t level;
+        uint32_t pieces;
+        bool survived;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory needs address-free atomics");
+
+    // Slots of a batch and the queue of the games left to play, mapped shared before the workers are forked.
+    // Workers claim queue entries by incrementing next.
+    class Arena final {
+    public:
+        explicit Arena(size_t capacity) :
+            capacity_{ capacity },
+            size_{ sizeof(Header) + capacity * sizeof(Slot) + capacity * sizeof(uint32_t) },
+            memory_{ mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) }
+        {
+            if (memory_ == MAP_FAILED) {
+                std::perror("mmap");
+                std::exit(1);
+            }
+            header_ = new (memory_) Header{};
+            slots_ = reinterpret_cast<Slot*>(static_cast<char*>(memory_) + sizeof(Header));
+            queue_ = reinterpret_cast<uint32_t*>(slots_ + capacity);
+        }
+
+        ~Arena() { munmap(memory_, size_); }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        // Starts a batch of count pending games.
+        void clear(size_t count) noexcept {
+            assert(count <= capacity_ && "Batch doesn't fit the arena");
+            for (size_t i = 0; i < count; ++i) {
+                new (&slots_[i]) Slot{};
+            }
+            count_ = count;
+        }
+
+        // Queues the games that aren't done for another round of workers, and returns how many there are. A game
+        // still claimed was being played by a worker that crashed, it fails once that happened max_attempts times.
+        size_t queue_unfinished(uint32_t max_attempts) noexcept {
+            uint32_t queued = 0;
+            for (uint32_t i = 0; i < count_; ++i) {
+                auto& slot = slots_[i];
+                auto state = slot.state.load(std::memory_order_acquire);
+                if (state != Slot::PENDING && state != Slot::CLAIMED) {
+                    continue;
+                }
+                if (state == Slot::CLAIMED && ++slot.attempts == max_attempts) {
+                    slot.state.store(Slot::FAILED, std::memory_order_relaxed);
+                    continue;
+                }
+                slot.state.store(Slot::PENDING, std::memory_order_relaxed);
+                queue_[queued++] = i;
+            }
+            header_->queued = queued;
+            header_->next.store(0, std::memory_order_relaxed);
+            return queued;
+        }
+
+        // Index of the next game to play, or -1 once the queue is empty.
+        long claim() noexcept {
+            auto i = header_->next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= header_->queued) {
+                return -1;
+            }
+            auto& slot = slots_[queue_[i]];
+            slot.state.store(Slot::CLAIMED, std::memory_order_relaxed);
+            return queue_[i];
+        }
+
+        Slot& operator[](size_t i) noexcept { return slots_[i]; }
+        size_t count() const noexcept { return count_; }
+
+    private:
+        struct alignas(64) Header final {
+            std::atomic<uint32_t> next{ 0 };
+            uint32_t queued = 0;
+        };
+
+    private:
+        size_t capacity_;
+        size_t size_;
+        void* memory_;
+        Header* header_;
+        Slot* slots_;
+        uint32_t* queue_;
+        size_t count_ = 0;
+    };
+
+    // A batch: every candidate plays the games with seeds first_seed and on.
+    struct Batch final {
+        std::vector<Candidate> candidates;
+        uint64_t first_seed;
+        size_t games;
+    };
+
+    void play(const Options& options, const Candidate& candidate, uint64_t seed, tetris::ThreadPool& pool, Slot& slot) {
+        size_t preview_depth = std::max<size_t>(options.depth - 1, 1);
+        tetris::Tetris game{ seed, preview_depth, candidate.rules };
+        tetris::BeamSearchBot bot{ pool, tetris::BotConfig{ options.beam, options.depth, candidate.weights } };
+        uint32_t pieces = 0;
+        while (!game.game_over() && pieces < options.max_pieces) {
+            game.update(0);
+            for (size_t tick = 0; tick < options.reaction_ticks && !game.tetromino().is_undef(); ++tick) {
+                game.update(tetris::NS_PER_TICK);
+            }
+            if (game.game_over()) {
+                break;
+            }
+            if (!game.tetromino().is_undef()) {
+                auto tetromino = bot.choose(game);
+                if (!tetromino.is_undef()) {
+                    game.lock(tetromino);
+                }
+                // Gravity locks it wherever it falls when nothing can be reached.
+                while (!game.game_over() && !game.tetromino().is_undef()) {
+                    game.update(tetris::NS_PER_TICK);
+                }
+            }
+            ++pieces;
+        }
+        slot.score = game.score();
+        slot.lines = static_cast<uint32_t>(game.cleared_lines());
+        slot.level = static_cast<uint32_t>(game.level());
+        slot.pieces = pieces;
+        slot.survived = !game.game_over();
+    }
+
+    // Plays games from the queue until it's empty. Runs in a forked worker.
+    void work(const Options& options, const Batch& batch, Arena& arena) {
+        tetris::ThreadPool pool{ 1 };
+        for (long i = arena.claim(); i >= 0; i = arena.claim()) {
+            auto& slot = arena[static_cast<size_t>(i)];
+            auto game = static_cast<size_t>(i);
+            play(options, batch.candidates[game / batch.games], batch.first_seed + game % batch.games, pool, slot);
+            slot.state.store(Slot::DONE, std::memory_order_release);
+        }
+    }
+
+    std::vector<int> allowed_cpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (cpus.empty()) {
+            cpus.push_back(0);
+        }
+        return cpus;
+    }
+
+    struct BatchTotals final {
+        size_t games = 0;
+        size_t failed = 0;
+        size_t crashes = 0;
+        double seconds = 0;
+    };
+
+    // Plays the batch on the workers, each pinned to a core of its own while there are enough. Games still
+    // unfinished after a worker crashed are played by a new round of workers, and fail once they crashed
+    // MAX_ATTEMPTS workers.
+    BatchTotals run_batch(const Options& options, const Batch& batch, Arena& arena, size_t workers, const std::vector<int>& cpus) {
+        constexpr uint32_t MAX_ATTEMPTS = 3;
+        BatchTotals totals;
+        auto start = steady_now();
+        arena.clear(batch.candidates.size() * batch.games);
+        while (size_t queued = arena.queue_unfinished(MAX_ATTEMPTS)) {
+            std::fflush(stdout);
+            std::vector<pid_t> children;
+            for (size_t w = 0; w < std::min(workers, queued); ++w) {
+                pid_t pid = fork();
+                if (pid < 0) {
+                    std::perror("fork");
+                    break;
+                }
+                if (pid == 0) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpus[w % cpus.size()], &set);
+                    sched_setaffinity(0, sizeof(set), &set);
+                    work(options, batch, arena);
+                    _exit(0);
+                }
+                children.push_back(pid);
+            }
+            if (children.empty()) {
+                std::exit(1);
+            }
+            for (auto pid : children) {
+                int status = 0;
+                while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+                }
+                if (WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status))) {
+                    ++totals.crashes;
+                    if (WIFSIGNALED(status)) {
+                        std::fprintf(stderr, "Worker %d was killed by signal %d, retrying its games\n", pid, WTERMSIG(status));
+                    }
+                    else {
+                        std::fprintf(stderr, "Worker %d exited with %d, retrying its games\n", pid, WEXITSTATUS(status));
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < arena.count(); ++i) {
+            auto state = arena[i].state.load(std::memory_order_acquire);
+            totals.games += state == Slot::DONE;
+            totals.failed += state == Slot::FAILED;
+        }
+        totals.seconds = (steady_now() - start) / 1e9;
+        return totals;
+    }
+
+    struct Stats final {
+        double score = 0;
+        double lines = 0;
+        double level = 0;
+        double pieces = 0;
+        double survival = 0;
+        size_t games = 0;
+    };
+
+    // Means over the finished games of the candidate.
+    Stats candidate_stats(Arena& arena, size_t candidate, size_t games) {
+        Stats stats;
+        for (size_t i = candidate * games; i < (candidate + 1) * games; ++i) {
+            const auto& slot = arena[i];
+            if (slot.state.load(std::memory_order_acquire) != Slot::DONE) {
+                continue;
+            }
+            stats.score += static_cast<double>(slot.score);
+            stats.lines += slot.lines;
+            stats.level += slot.level;
+            stats.pieces += slot.pieces;
+            stats.survival += slot.survived;
+            ++stats.games;
+        }
+        if (stats.games) {
+            for (auto* stat : { &stats.score, &stats.lines, &stats.level, &stats.pieces, &stats.survival }) {
+                *stat /= static_cast<double>(stats.games);
+            }
+        }
+        return stats;
+    }
+
+    double fitness(const Options& options, const Stats& stats) {
+        if (!stats.games) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        double value = options.objective == "lines" ? stats.lines
+            : options.objective == "level" ? stats.level
+            : options.objective == "pieces" ? stats.pieces
+            : options.objective == "survival" ? stats.survival
+            : stats.score;
+        return options.has_target ? -std::abs(value - options.target) : value;
+    }
+
+    // Real coded genetic algorithm: the best candidates survive as they are, the rest of the next population
+    // are blends of tournament winners with gaussian mutations that shrink over the generations.
+    class GeneticOptimizer final {
+    public:
+        GeneticOptimizer(std::vector<const Parameter*> parameters, const Genome& initial, size_t population, uint64_t seed) :
+            parameters_{ std::move(parameters) },
+            random_{ seed },
+            sigma_{ INITIAL_SIGMA }
+        {
+            // The first member is the initial genome as is.
+            for (size_t i = 0; i < initial.size(); ++i) {
+                assert(initial[i] >= parameters_[i]->low && initial[i] <= parameters_[i]->high && "Initial genome is outside the parameter ranges");
+            }
+            population_.push_back(initial);
+            while (population_.size() < population) {
+                auto genome = initial;
+                for (size_t i = 0; i < genome.size(); ++i) {
+                    genome[i] = clamp_(i, genome[i] + 2 * sigma_ * range_(i) * gaussian_());
+                }
+                population_.push_back(std::move(genome));
+            }
+        }
+
+        const std::vector<Genome>& population() const noexcept { return population_; }
+
+        // Breeds the next population from the fitness of the current one.
+        void evolve(const std::vector<double>& fitness) {
+            std::vector<size_t> order(population_.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return fitness[a] > fitness[b]; });
+            std::vector<Genome> next;
+            size_t elites = std::max<size_t>(population_.size() / 8, 1);
+            for (size_t i = 0; i < elites; ++i) {
+                next.push_back(population_[order[i]]);
+            }
+            while (next.size() < population_.size()) {
+                const auto& first = population_[tournament_(fitness)];
+                const auto& second = population_[tournament_(fitness)];
+                Genome child(first.size());
+                for (size_t i = 0; i < child.size(); ++i) {
+                    // Blending beyond the parents keeps the spread of the population from collapsing.
+                    double blend = -BLEND_MARGIN + (1 + 2 * BLEND_MARGIN) * uniform_();
+                    child[i] = first[i] + blend * (second[i] - first[i]);
+                    if (uniform_() < MUTATION_RATE) {
+                        child[i] += sigma_ * range_(i) * gaussian_();
+                    }
+                    child[i] = clamp_(i, child[i]);
+                }
+                next.push_back(std::move(child));
+            }
+            population_ = std::move(next);
+            sigma_ = std::max(sigma_ * SIGMA_DECAY, MIN_SIGMA);
+        }
+
+    private:
+        static constexpr double INITIAL_SIGMA = 0.1; // of the range of a parameter
+        static constexpr double MIN_SIGMA = 0.01;
+        static constexpr double SIGMA_DECAY = 0.9;
+        static constexpr double BLEND_MARGIN = 0.25;
+        static constexpr double MUTATION_RATE = 0.3;
+        static constexpr size_t TOURNAMENT_SIZE = 3;
+
+    private:
+        double range_(size_t i) const noexcept { return parameters_[i]->high - parameters_[i]->low; }
+
+        double clamp_(size_t i, double value) const noexcept {
+            return std::clamp(value, parameters_[i]->low, parameters_[i]->high);
+        }
+
+        double uniform_() noexcept { return random_.next() / 4294967296.0; }
+
+        double gaussian_() noexcept {
+            // Box-Muller, 1 - uniform_() is never 0.
+            return std::sqrt(-2 * std::log(1 - uniform_())) * std::cos(6.283185307179586 * uniform_());
+        }
+
+        size_t tournament_(const std::vector<double>& fitness) noexcept {
+            auto best = random_.bounded(static_cast<uint32_t>(population_.size()));
+            for (size_t i = 1; i < TOURNAMENT_SIZE; ++i) {
+                auto other = random_.bounded(static_cast<uint32_t>(population_.size()));
+                if (fitness[other] > fitness[best]) {
+                    best = other;
+                }
+            }
+            return best;
+        }
+
+    private:
+        std::vector<const Parameter*> parameters_;
+        std::vector<Genome> population_;
+        tetris::Random random_;
+        double sigma_;
+    };
+
+    size_t parse_count(const char* text, bool zero = false) {
+        char* end = nullptr;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end || *text == '-' || (!value && !zero)) {
+            std::fprintf(stderr, "Expected a positive number, got '%s'\n", text);
+            std::exit(1);
+        }
+        return value;
+    }
+
+    double parse_number(const char* text) {
+        char* end = nullptr;
+        auto value = std::strtod(text, &end);
+        if (*end || end == text) {
+            std::fprintf(stderr, "Expected a number, got '%s'\n", text);
+            std::exit(1);
+        }
+        return value;
+    }
+
+    std::vector<std::string> split(const char* text) {
+        std::vector<std::string> parts;
+        std::string part;
+        for (const char* c = text; ; ++c) {
+            if (*c == ',' || !*c) {
+                parts.push_back(part);
+                part.clear();
+                if (!*c) {
+                    break;
+                }
+            }
+            else {
+                part += *c;
+            }
+        }
+        return parts;
+    }
+
+    void print_stats(const Stats& stats) {
+        std::printf("score %.0f lines %.1f level %.1f pieces %.0f survival %.2f", stats.score, stats.lines, stats.level,
+            stats.pieces, stats.survival);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--scaling") {
+            options.scaling = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Unknown option or missing value '%s'\n", argv[i]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if (option == "--params") {
+            options.groups = split(value);
+        }
+        else if (option == "--objective") {
+            options.objective = value;
+        }
+        else if (option == "--target") {
+            options.has_target = true;
+            options.target = parse_number(value);
+        }
+        else if (option == "--generations") {
+            options.generations = parse_count(value);
+        }
+        else if (option == "--population") {
+            options.population = parse_count(value);
+        }
+        else if (option == "--games") {
+            options.games = parse_count(value);
+        }
+        else if (option == "--max-pieces") {
+            options.max_pieces = parse_count(value);
+        }
+        else if (option == "--reaction-ticks") {
+            options.reaction_ticks = parse_count(value, true);
+        }
+        else if (option == "--beam") {
+            options.beam = parse_count(value);
+        }
+        else if (option == "--depth") {
+            options.depth = std::min(parse_count(value), tetris::PreviewQueue::MAX_DEPTH + 1);
+        }
+        else if (option == "--workers") {
+            options.workers = parse_count(value);
+        }
+        else if (option == "--seed") {
+            options.seed = parse_count(value, true);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option '%s'\n", option.c_str());
+            return 1;
+        }
+    }
+    const char* const OBJECTIVES[] = { "score", "lines", "level", "pieces", "survival" };
+    if (std::none_of(std::begin(OBJECTIVES), std::end(OBJECTIVES), [&](const char* name) { return options.objective == name; })) {
+        std::fprintf(stderr, "Unknown objective '%s'\n", options.objective.c_str());
+        return 1;
+    }
+
+    std::vector<const Parameter*> parameters;
+    for (auto&& group : options.groups) {
+        size_t found = 0;
+        for (auto&& parameter : PARAMETERS) {
+            if (group == parameter.group) {
+                parameters.push_back(&parameter);
+                ++found;
+            }
+        }
+        if (!found) {
+            std::fprintf(stderr, "Unknown parameter group '%s'\n", group.c_str());
+            return 1;
+        }
+    }
+    Genome initial;
+    for (auto* parameter : parameters) {
+        initial.push_back(parameter->get(Candidate{}));
+    }
+
+    auto cpus = allowed_cpus();
+    size_t workers = options.workers ? options.workers : cpus.size();
+    GeneticOptimizer optimizer{ parameters, initial, options.population, options.seed };
+    Arena arena{ options.population * options.games };
+    auto make_batch = [&](size_t generation) {
+        Batch batch{ {}, options.seed + generation * options.games, options.games };
+        for (auto&& genome : optimizer.population()) {
+            batch.candidates.push_back(make_candidate(parameters, genome));
+        }
+        return batch;
+    };
+
+    if (options.scaling) {
+        auto batch = make_batch(0);
+        double base = 0;
+        std::printf("%zu games of %zu candidates, %zu cores available\n", options.population * options.games, options.population,
+            cpus.size());
+        std::printf("workers    games/s   speedup  efficiency\n");
+        for (size_t n = 1; ; n = std::min(n * 2, workers)) {
+            auto totals = run_batch(options, batch, arena, n, cpus);
+            double rate = totals.games / totals.seconds;
+            if (n == 1) {
+                base = rate;
+            }
+            std::printf("%7zu %10.1f %9.2f %11.2f\n", n, rate, rate / base, rate / base / n);
+            if (n == workers) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    std::printf("Tuning %zu parameters, %zu candidates of %zu games on %zu workers, objective %s", parameters.size(),
+        options.population, options.games, workers, options.objective.c_str());
+    if (options.has_target) {
+        std::printf(" near %g", options.target);
+    }
+    std::printf("\n");
+    size_t total_games = 0;
+    double total_seconds = 0;
+    std::vector<double> scores(options.population);
+    size_t best = 0;
+    Stats best_stats;
+    for (size_t generation = 0; generation < options.generations; ++generation) {
+        auto batch = make_batch(generation);
+        auto totals = run_batch(options, batch, arena, workers, cpus);
+        total_games += totals.games;
+        total_seconds += totals.seconds;
+        best = 0;
+        double mean = 0;
+        for (size_t i = 0; i < options.population; ++i) {
+            auto stats = candidate_stats(arena, i, options.games);
+            scores[i] = fitness(options, stats);
+            mean += scores[i] / static_cast<double>(options.population);
+            if (i == 0 || scores[i] > scores[best]) {
+                best = i;
+                best_stats = stats;
+            }
+        }
+        std::printf("generation %zu: best %.2f (", generation, scores[best]);
+        print_stats(best_stats);
+        std::printf("), mean %.2f, %.1f games/s", mean, totals.games / totals.seconds);
+        if (totals.crashes || totals.failed) {
+            std::printf(", %zu worker crashes, %zu games failed", totals.crashes, totals.failed);
+        }
+        std::printf("\n");
+        if (generation + 1 < options.generations) {
+            optimizer.evolve(scores);
+        }
+    }
+    std::printf("%zu games in %.1f s, %.1f games/s\n", total_games, total_seconds, total_games / total_seconds);
+    std::printf("best of the last generation:\n");
+    auto best_candidate = make_candidate(parameters, optimizer.population()[best]);
+    for (auto* parameter : parameters) {
+        std::printf("  %s = %g\n", parameter->name, parameter->get(best_candidate));
+    }
+    return 0;
+}